@@ -0,0 +1,319 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "audio.h"
+#include "corpus.h"
+#include "silk.h"
+#include "video.h"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+namespace {
+    using corpus::Signal;
+
+    void discard(void*, const uint8_t*, int) {}
+
+    // Inputs are generated once per key and shared by every thread of every benchmark
+    template<typename Key>
+    const std::vector<uint8_t>& cached(const Key& key, std::vector<uint8_t> (*make)(const Key&)) {
+        static std::mutex mutex;
+        static std::map<Key, std::vector<uint8_t>> cache;
+        std::lock_guard lock(mutex);
+        auto it = cache.find(key);
+        if (it == cache.end()) {
+            it = cache.emplace(key, make(key)).first;
+        }
+        return it->second;
+    }
+
+    using PcmKey = std::tuple<int, int, int, int>; // Signal, sample rate, channels, seconds
+    const std::vector<uint8_t>& pcm_input(Signal signal, int sample_rate, int channels, int seconds) {
+        return cached<PcmKey>({ static_cast<int>(signal), sample_rate, channels, seconds }, [](const PcmKey& key) {
+            return corpus::pcm(static_cast<Signal>(std::get<0>(key)), std::get<1>(key), std::get<2>(key), std::get<3>(key));
+        });
+    }
+
+    using SilkKey = std::tuple<int, int>; // Signal, seconds
+    const std::vector<uint8_t>& silk_input(Signal signal, int seconds) {
+        return cached<SilkKey>({ static_cast<int>(signal), seconds }, [](const SilkKey& key) {
+            return corpus::silk(static_cast<Signal>(std::get<0>(key)), std::get<1>(key));
+        });
+    }
+
+    using AudioKey = std::tuple<int, int>; // Format, seconds
+    const std::vector<uint8_t>& audio_input(corpus::AudioFormat format, int seconds) {
+        return cached<AudioKey>({ static_cast<int>(format), seconds }, [](const AudioKey& key) {
+            return corpus::audio(static_cast<corpus::AudioFormat>(std::get<0>(key)), Signal::Sine, std::get<1>(key));
+        });
+    }
+
+    using VideoKey = std::tuple<int, int, int>; // Format, width, height
+    const std::vector<uint8_t>& video_input(corpus::VideoFormat format, int width, int height) {
+        return cached<VideoKey>({ static_cast<int>(format), width, height }, [](const VideoKey& key) {
+            return corpus::video(static_cast<corpus::VideoFormat>(std::get<0>(key)), std::get<1>(key), std::get<2>(key), 2.0);
+        });
+    }
+
+    // Times every call and reports throughput, latency percentiles, allocations per call and peak RSS.
+    // media_seconds is the audio or video duration one call processes, 0 leaves out the realtime factor.
+    template<typename Call>
+    void measure(benchmark::State& state, int64_t bytes, double media_seconds, Call&& call) {
+        using clock = std::chrono::steady_clock;
+        std::vector<double> latencies;
+        latencies.reserve(1024);
+
+        const uint64_t allocations_before = alloc_counter::allocations();
+        for (auto _ : state) {
+            const auto start = clock::now();
+            if (call() != 0) {
+                state.SkipWithError("call failed");
+                break;
+            }
+            latencies.push_back(std::chrono::duration<double, std::milli>(clock::now() - start).count());
+        }
+        const uint64_t allocations = alloc_counter::allocations() - allocations_before;
+        if (latencies.empty()) return;
+
+        state.SetBytesProcessed(state.iterations() * bytes);
+        if (media_seconds > 0) {
+            // Seconds of media per second of wall time, summed over the threads
+            state.counters["rtf"] = benchmark::Counter(media_seconds * static_cast<double>(state.iterations()),
+                                                       benchmark::Counter::kIsRate);
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&](double p) {
+            return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * static_cast<double>(latencies.size())))];
+        };
+        state.counters["p50_ms"] = benchmark::Counter(percentile(0.50), benchmark::Counter::kAvgThreads);
+        state.counters["p95_ms"] = benchmark::Counter(percentile(0.95), benchmark::Counter::kAvgThreads);
+        state.counters["p99_ms"] = benchmark::Counter(percentile(0.99), benchmark::Counter::kAvgThreads);
+
+        if (alloc_counter::available()) {
+            // The counter is process wide, so with threads it also holds the calls of the other threads
+            const double calls = static_cast<double>(state.iterations()) * state.threads();
+            state.counters["allocs_per_call"] = benchmark::Counter(static_cast<double>(allocations) / calls,
+                                                                   benchmark::Counter::kAvgThreads);
+        }
+        state.counters["peak_rss_mb"] = benchmark::Counter(static_cast<double>(alloc_counter::peak_rss_bytes()) / (1024 * 1024),
+                                                           benchmark::Counter::kAvgThreads);
+    }
+}
+
+// Args: seconds, signal
+static void BM_SilkEncode(benchmark::State& state) {
+    const auto seconds = static_cast<int>(state.range(0));
+    auto& pcm = pcm_input(static_cast<Signal>(state.range(1)), SILKV3_SAMPLE_RATE, 1, seconds);
+    measure(state, static_cast<int64_t>(pcm.size()), seconds, [&] {
+        return silk_encode(const_cast<uint8_t*>(pcm.data()), static_cast<int>(pcm.size()), discard, nullptr);
+    });
+}
+BENCHMARK(BM_SilkEncode)->ArgNames({ "seconds", "noise" })
+    ->ArgsProduct({ { 1, 10, 60 }, { 0, 1 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_SilkEncode)->Name("BM_SilkEncode/mt")->ArgNames({ "seconds", "noise" })->Args({ 10, 0 })
+    ->Threads(2)->Threads(4)->Threads(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Arg: preset index into the names below
+static void BM_SilkEncodePreset(benchmark::State& state) {
+    static const char* presets[] = { "default", "fast", "balanced", "quality" };
+    const char* name = presets[state.range(0)];
+    state.SetLabel(name);
+
+    SilkEncoderOptions options = {};
+    silk_encoder_options_preset(name, &options);
+    auto& pcm = pcm_input(Signal::Sine, SILKV3_SAMPLE_RATE, 1, 10);
+    measure(state, static_cast<int64_t>(pcm.size()), 10, [&] {
+        return silk_encode_ex(const_cast<uint8_t*>(pcm.data()), static_cast<int>(pcm.size()), &options, discard, nullptr);
+    });
+}
+BENCHMARK(BM_SilkEncodePreset)->DenseRange(0, 3)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Args: sample rate, channels, the SDK resamples and the encoder downmixes
+static void BM_SilkEncodeInputRate(benchmark::State& state) {
+    SilkEncoderOptions options = {};
+    silk_encoder_options_preset("default", &options);
+    options.sampleRate = static_cast<int>(state.range(0));
+    options.channels = static_cast<int>(state.range(1));
+
+    auto& pcm = pcm_input(Signal::Sine, options.sampleRate, options.channels, 10);
+    measure(state, static_cast<int64_t>(pcm.size()), 10, [&] {
+        return silk_encode_ex(const_cast<uint8_t*>(pcm.data()), static_cast<int>(pcm.size()), &options, discard, nullptr);
+    });
+}
+BENCHMARK(BM_SilkEncodeInputRate)->ArgNames({ "rate", "channels" })
+    ->ArgsProduct({ { 16000, 24000, 48000 }, { 1, 2 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Arg: segments, 0 for one per pool thread
+static void BM_SilkEncodeParallel(benchmark::State& state) {
+    auto& pcm = pcm_input(Signal::Sine, SILKV3_SAMPLE_RATE, 1, 60);
+    measure(state, static_cast<int64_t>(pcm.size()), 60, [&] {
+        return silk_encode_parallel(const_cast<uint8_t*>(pcm.data()), static_cast<int>(pcm.size()), nullptr,
+                                    static_cast<int>(state.range(0)), discard, nullptr);
+    });
+}
+BENCHMARK(BM_SilkEncodeParallel)->ArgName("segments")->Arg(0)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Args: seconds, signal
+static void BM_SilkDecode(benchmark::State& state) {
+    const auto seconds = static_cast<int>(state.range(0));
+    auto& silk = silk_input(static_cast<Signal>(state.range(1)), seconds);
+    measure(state, static_cast<int64_t>(silk.size()), seconds, [&] {
+        return silk_decode(const_cast<uint8_t*>(silk.data()), static_cast<int>(silk.size()), discard, nullptr);
+    });
+}
+BENCHMARK(BM_SilkDecode)->ArgNames({ "seconds", "noise" })
+    ->ArgsProduct({ { 1, 10, 60 }, { 0, 1 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_SilkDecode)->Name("BM_SilkDecode/mt")->ArgNames({ "seconds", "noise" })->Args({ 10, 0 })
+    ->Threads(2)->Threads(4)->Threads(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_SilkDecodeInto(benchmark::State& state) {
+    auto& silk = silk_input(Signal::Sine, 10);
+    std::vector<uint8_t> out(silk_decode_max_output_size(silk.data(), static_cast<int>(silk.size())));
+    measure(state, static_cast<int64_t>(silk.size()), 10, [&] {
+        const int written = silk_decode_into(const_cast<uint8_t*>(silk.data()), static_cast<int>(silk.size()),
+                                             out.data(), static_cast<int>(out.size()));
+        return written < 0 ? 1 : 0;
+    });
+}
+BENCHMARK(BM_SilkDecodeInto)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Args: format, seconds
+static void BM_AudioToPcm(benchmark::State& state) {
+    const auto format = static_cast<corpus::AudioFormat>(state.range(0));
+    const auto seconds = static_cast<int>(state.range(1));
+    state.SetLabel(corpus::audio_format_name(format));
+
+    auto& audio = audio_input(format, seconds);
+    if (audio.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+    measure(state, static_cast<int64_t>(audio.size()), seconds, [&] {
+        return audio_to_pcm(const_cast<uint8_t*>(audio.data()), static_cast<int>(audio.size()), discard, nullptr);
+    });
+}
+BENCHMARK(BM_AudioToPcm)->ArgNames({ "format", "seconds" })
+    ->ArgsProduct({ { 0, 1, 2, 3 }, { 10, 60 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_AudioToPcm)->Name("BM_AudioToPcm/mt")->ArgNames({ "format", "seconds" })->Args({ 2, 10 })
+    ->Threads(2)->Threads(4)->Threads(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Args: pipelined, trim silence
+static void BM_AudioToSilk(benchmark::State& state) {
+    AudioToSilkOptions options = {};
+    options.pipelined = static_cast<int>(state.range(0));
+    options.trimSilence = static_cast<int>(state.range(1));
+
+    auto& audio = audio_input(corpus::AudioFormat::M4aAac, 10);
+    if (audio.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+    measure(state, static_cast<int64_t>(audio.size()), 10, [&] {
+        return audio_to_silk(const_cast<uint8_t*>(audio.data()), static_cast<int>(audio.size()), &options, discard, nullptr);
+    });
+}
+BENCHMARK(BM_AudioToSilk)->ArgNames({ "pipelined", "trim" })
+    ->ArgsProduct({ { 0, 1 }, { 0, 1 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+constexpr int resolutions[][2] = { { 320, 240 }, { 1280, 720 }, { 1920, 1080 } };
+
+// Args: format, resolution index, fast probe
+static void BM_VideoGetSize(benchmark::State& state) {
+    const auto format = static_cast<corpus::VideoFormat>(state.range(0));
+    const auto& resolution = resolutions[state.range(1)];
+    state.SetLabel(corpus::video_format_name(format));
+
+    auto& video = video_input(format, resolution[0], resolution[1]);
+    if (video.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+    const LagrangeProbeOptions probe = { 64 * 1024, 0, 1, nullptr };
+    const LagrangeProbeOptions* probe_options = state.range(2) ? &probe : nullptr;
+    measure(state, static_cast<int64_t>(video.size()), 0, [&] {
+        VideoInfo info = {};
+        return video_get_size_ex(const_cast<uint8_t*>(video.data()), static_cast<int>(video.size()), probe_options, info);
+    });
+}
+BENCHMARK(BM_VideoGetSize)->ArgNames({ "format", "resolution", "fast_probe" })
+    ->ArgsProduct({ { 0, 1 }, { 0, 1, 2 }, { 0, 1 } })->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+// Args: format, resolution index
+static void BM_VideoFirstFrame(benchmark::State& state) {
+    const auto format = static_cast<corpus::VideoFormat>(state.range(0));
+    const auto& resolution = resolutions[state.range(1)];
+    state.SetLabel(corpus::video_format_name(format));
+
+    auto& video = video_input(format, resolution[0], resolution[1]);
+    if (video.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+    measure(state, static_cast<int64_t>(video.size()), 0, [&] {
+        uint8_t* out = nullptr;
+        int out_len = 0;
+        const int ret = video_first_frame(const_cast<uint8_t*>(video.data()), static_cast<int>(video.size()), out, out_len);
+        av_free(out);
+        return ret;
+    });
+}
+BENCHMARK(BM_VideoFirstFrame)->ArgNames({ "format", "resolution" })
+    ->ArgsProduct({ { 0, 1 }, { 0, 1, 2 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_VideoFirstFrame)->Name("BM_VideoFirstFrame/mt")->ArgNames({ "format", "resolution" })->Args({ 0, 2 })
+    ->Threads(2)->Threads(4)->Threads(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Args: resolution index, fast decode. 200 px JPEG, the size chat clients show
+static void BM_VideoThumbnail(benchmark::State& state) {
+    const auto& resolution = resolutions[state.range(0)];
+    auto& video = video_input(corpus::VideoFormat::Mp4Mpeg4, resolution[0], resolution[1]);
+    if (video.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+
+    ThumbnailOptions options = { 200, 200, LAGRANGE_SCALE_BILINEAR, LAGRANGE_IMAGE_JPEG, 75, nullptr };
+    options.fastDecode = static_cast<int>(state.range(1));
+    measure(state, static_cast<int64_t>(video.size()), 0, [&] {
+        uint8_t* out = nullptr;
+        int out_len = 0;
+        const int ret = video_thumbnail(const_cast<uint8_t*>(video.data()), static_cast<int>(video.size()), &options, out, out_len);
+        av_free(out);
+        return ret;
+    });
+}
+BENCHMARK(BM_VideoThumbnail)->ArgNames({ "resolution", "fast" })
+    ->ArgsProduct({ { 0, 1, 2 }, { 0, 1 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Arg: sprite columns, 0 for separate images. Eight keyframes of a 2 s clip
+static void BM_VideoFrames(benchmark::State& state) {
+    auto& video = video_input(corpus::VideoFormat::Mp4Mpeg4, 1280, 720);
+    if (video.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+
+    VideoFramesOptions options = {};
+    options.count = 8;
+    options.spriteColumns = static_cast<int>(state.range(0));
+    options.thumbnail = { 160, 160, LAGRANGE_SCALE_BILINEAR, LAGRANGE_IMAGE_JPEG, 75, nullptr };
+    measure(state, static_cast<int64_t>(video.size()), 0, [&] {
+        return video_frames(const_cast<uint8_t*>(video.data()), static_cast<int>(video.size()), &options, discard, nullptr);
+    });
+}
+BENCHMARK(BM_VideoFrames)->ArgName("columns")->Arg(0)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,106 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__)
+#define LAGRANGECODEC_BENCH_MALLOC_HOOKS
+#endif
+
+namespace {
+    std::atomic<uint64_t> counter { 0 };
+}
+
+#ifdef LAGRANGECODEC_BENCH_MALLOC_HOOKS
+
+// glibc keeps its allocator reachable under these names, so the hooks need no dlsym
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    counter.fetch_add(1, std::memory_order_relaxed);
+    void* p = __libc_memalign(alignment, size);
+    if (!p && size) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+}
+
+#endif
+
+namespace alloc_counter {
+    bool available() {
+#ifdef LAGRANGECODEC_BENCH_MALLOC_HOOKS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    uint64_t allocations() {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+    uint64_t peak_rss_bytes() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters {};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return static_cast<uint64_t>(usage.ru_maxrss); // Bytes on macOS
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // KiB on Linux
+#endif
+#endif
+    }
+}
@@ -0,0 +1,22 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_BENCH_ALLOC_COUNTER_H
+#define LAGRANGECODEC_BENCH_ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// Heap allocations of the whole process, counted by interposing malloc and friends on glibc.
+// FFmpeg's av_malloc (posix_memalign) and operator new land here too.
+namespace alloc_counter {
+    // False where the hooks are not built, allocations() then stays at 0
+    bool available();
+
+    uint64_t allocations();
+
+    // Peak resident set size of the process in bytes
+    uint64_t peak_rss_bytes();
+}
+
+#endif //LAGRANGECODEC_BENCH_ALLOC_COUNTER_H
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+#
+# Created by Wenxuan Lin on 2026-10-16.
+#
+# Compares two LagrangeCodecBench JSON reports and fails when a benchmark got slower than the threshold.
+#
+#   LagrangeCodecBench --benchmark_out=baseline.json --benchmark_out_format=json
+#   ... change something, rebuild ...
+#   LagrangeCodecBench --benchmark_out=current.json --benchmark_out_format=json
+#   python3 bench/compare_baseline.py baseline.json current.json --threshold 10
+#
+# With --benchmark_repetitions only the median aggregate of each benchmark is compared.
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        report = json.load(f)
+
+    results = {}
+    for entry in report.get("benchmarks", []):
+        if entry.get("error_occurred"):
+            continue
+        run_type = entry.get("run_type", "iteration")
+        if run_type == "aggregate" and entry.get("aggregate_name") != "median":
+            continue
+        name = entry.get("run_name", entry["name"])
+        # A median aggregate wins over the single iterations of the same benchmark
+        if run_type == "iteration" and name in results:
+            continue
+        results[name] = entry
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two LagrangeCodecBench JSON reports")
+    parser.add_argument("baseline", help="JSON report of the reference build")
+    parser.add_argument("current", help="JSON report of the build under test")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown of real_time in percent (default 10)")
+    parser.add_argument("--filter", default="", help="only compare benchmarks whose name contains this")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = []
+    width = max((len(name) for name in current), default=0)
+    for name, entry in current.items():
+        if args.filter not in name:
+            continue
+        if name not in baseline:
+            print(f"{name:<{width}}  new")
+            continue
+
+        old = baseline[name]["real_time"]
+        new = entry["real_time"]
+        if baseline[name].get("time_unit") != entry.get("time_unit") or old <= 0:
+            print(f"{name:<{width}}  not comparable")
+            continue
+
+        change = (new - old) / old * 100
+        marker = ""
+        if change > args.threshold:
+            marker = "  REGRESSION"
+            regressions.append(name)
+        print(f"{name:<{width}}  {old:12.3f} -> {new:12.3f} {entry.get('time_unit', '')}  {change:+7.1f}%{marker}")
+
+    for name in baseline:
+        if name not in current and args.filter in name:
+            print(f"{name:<{width}}  missing")
+
+    if regressions:
+        print(f"\n{len(regressions)} benchmark(s) slower than the {args.threshold:g}% threshold", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,333 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include "corpus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#include "audio.h"
+#include "silk.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+}
+
+namespace {
+    constexpr double PI = 3.14159265358979;
+
+    // Deterministic white noise, the same sequence on every platform
+    struct Noise {
+        uint32_t state = 0x12345678;
+
+        double next() {
+            state = state * 1664525u + 1013904223u;
+            return static_cast<double>(state >> 8) / (1u << 24) * 2.0 - 1.0;
+        }
+    };
+
+    // Sample n of channel c in [-1, 1), a 440 Hz tone with a 5 Hz tremolo or noise
+    struct Generator {
+        corpus::Signal signal;
+        int sample_rate;
+        Noise noise;
+
+        double sample(int64_t n, int channel) {
+            if (signal == corpus::Signal::Noise) return 0.5 * noise.next();
+            const double t = static_cast<double>(n) / sample_rate;
+            return 0.5 * (0.75 + 0.25 * std::sin(2 * PI * 5 * t)) * std::sin(2 * PI * (440 + 110 * channel) * t);
+        }
+    };
+
+    void collect(void* userdata, const uint8_t* p, int len) {
+        auto* out = static_cast<std::vector<uint8_t>*>(userdata);
+        out->insert(out->end(), p, p + len);
+    }
+
+    // Seekable output for muxers such as mp4 that patch their header at the end
+    struct VectorOutput {
+        std::vector<uint8_t> data;
+        int64_t pos = 0;
+    };
+
+    int vector_write(void* opaque, uint8_t* buf, int size) {
+        auto* output = static_cast<VectorOutput*>(opaque);
+        if (output->pos + size > static_cast<int64_t>(output->data.size())) {
+            output->data.resize(output->pos + size);
+        }
+        memcpy(output->data.data() + output->pos, buf, size);
+        output->pos += size;
+        return size;
+    }
+
+    int64_t vector_seek(void* opaque, int64_t offset, int whence) {
+        auto* output = static_cast<VectorOutput*>(opaque);
+        switch (whence & ~AVSEEK_FORCE) {
+            case AVSEEK_SIZE: return static_cast<int64_t>(output->data.size());
+            case SEEK_SET: output->pos = offset; break;
+            case SEEK_CUR: output->pos += offset; break;
+            case SEEK_END: output->pos = static_cast<int64_t>(output->data.size()) + offset; break;
+            default: return AVERROR(EINVAL);
+        }
+        return output->pos;
+    }
+
+    // Runs frames through an encoder into a single stream container held in memory
+    class Muxer {
+    public:
+        ~Muxer() {
+            av_packet_free(&packet);
+            avcodec_free_context(&encoder);
+            if (format_context) {
+                if (format_context->pb) {
+                    av_freep(&format_context->pb->buffer);
+                    avio_context_free(&format_context->pb);
+                }
+                avformat_free_context(format_context);
+            }
+        }
+
+        // configure fills in the encoder parameters before it is opened
+        bool open(const char* format_name, const AVCodec* codec, const std::function<void(AVCodecContext*)>& configure) {
+            if (!codec || avformat_alloc_output_context2(&format_context, nullptr, format_name, nullptr) < 0) return false;
+
+            constexpr int buffer_size = 64 * 1024;
+            auto* buffer = static_cast<uint8_t*>(av_malloc(buffer_size));
+            format_context->pb = avio_alloc_context(buffer, buffer_size, 1, &output, nullptr, vector_write, vector_seek);
+            if (!format_context->pb) {
+                av_free(buffer);
+                return false;
+            }
+            format_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+            encoder = avcodec_alloc_context3(codec);
+            packet = av_packet_alloc();
+            stream = avformat_new_stream(format_context, nullptr);
+            if (!encoder || !packet || !stream) return false;
+
+            configure(encoder);
+            if (format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+                encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+            }
+            if (avcodec_open2(encoder, codec, nullptr) < 0) return false;
+            if (avcodec_parameters_from_context(stream->codecpar, encoder) < 0) return false;
+            stream->time_base = encoder->time_base;
+
+            return avformat_write_header(format_context, nullptr) >= 0;
+        }
+
+        AVCodecContext* context() const { return encoder; }
+
+        // Null flushes the encoder
+        bool write(const AVFrame* frame) {
+            if (avcodec_send_frame(encoder, frame) < 0) return false;
+
+            int ret;
+            while ((ret = avcodec_receive_packet(encoder, packet)) >= 0) {
+                av_packet_rescale_ts(packet, encoder->time_base, stream->time_base);
+                packet->stream_index = stream->index;
+                if (av_interleaved_write_frame(format_context, packet) < 0) return false;
+            }
+            return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+        }
+
+        std::vector<uint8_t> finish() {
+            if (!write(nullptr) || av_write_trailer(format_context) < 0) return {};
+            avio_flush(format_context->pb);
+            return std::move(output.data);
+        }
+
+    private:
+        AVFormatContext* format_context = nullptr;
+        AVCodecContext* encoder = nullptr;
+        AVStream* stream = nullptr;
+        AVPacket* packet = nullptr;
+        VectorOutput output;
+    };
+
+    void fill_audio(AVFrame* frame, Generator& generator, int64_t first) {
+        const auto format = static_cast<AVSampleFormat>(frame->format);
+        for (int i = 0; i < frame->nb_samples; i++) {
+            for (int c = 0; c < frame->channels; c++) {
+                const double value = generator.sample(first + i, c);
+                switch (format) {
+                    case AV_SAMPLE_FMT_S16:
+                        reinterpret_cast<int16_t*>(frame->data[0])[i * frame->channels + c] = static_cast<int16_t>(value * 32767);
+                        break;
+                    case AV_SAMPLE_FMT_S16P:
+                        reinterpret_cast<int16_t*>(frame->data[c])[i] = static_cast<int16_t>(value * 32767);
+                        break;
+                    case AV_SAMPLE_FMT_S32:
+                        reinterpret_cast<int32_t*>(frame->data[0])[i * frame->channels + c] = static_cast<int32_t>(value * 2147483647.0);
+                        break;
+                    case AV_SAMPLE_FMT_FLT:
+                        reinterpret_cast<float*>(frame->data[0])[i * frame->channels + c] = static_cast<float>(value);
+                        break;
+                    case AV_SAMPLE_FMT_FLTP:
+                        reinterpret_cast<float*>(frame->data[c])[i] = static_cast<float>(value);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    void fill_video(AVFrame* frame, int index) {
+        for (int y = 0; y < frame->height; y++) {
+            uint8_t* row = frame->data[0] + y * frame->linesize[0];
+            for (int x = 0; x < frame->width; x++) {
+                row[x] = static_cast<uint8_t>(x + y + index * 3);
+            }
+        }
+        for (int y = 0; y < frame->height / 2; y++) {
+            uint8_t* u = frame->data[1] + y * frame->linesize[1];
+            uint8_t* v = frame->data[2] + y * frame->linesize[2];
+            for (int x = 0; x < frame->width / 2; x++) {
+                u[x] = static_cast<uint8_t>(128 + y / 2 + index);
+                v[x] = static_cast<uint8_t>(64 + x / 2 + index * 5);
+            }
+        }
+    }
+}
+
+namespace corpus {
+    std::vector<uint8_t> pcm(Signal signal, int sample_rate, int channels, double seconds) {
+        const auto samples = static_cast<int64_t>(sample_rate * seconds);
+        std::vector<uint8_t> data(samples * channels * sizeof(int16_t));
+        Generator generator = { signal, sample_rate };
+        for (int64_t i = 0; i < samples; i++) {
+            for (int c = 0; c < channels; c++) {
+                const auto value = static_cast<uint16_t>(static_cast<int16_t>(generator.sample(i, c) * 32767));
+                data[(i * channels + c) * 2] = static_cast<uint8_t>(value & 0xFF);
+                data[(i * channels + c) * 2 + 1] = static_cast<uint8_t>(value >> 8);
+            }
+        }
+        return data;
+    }
+
+    std::vector<uint8_t> silk(Signal signal, double seconds) {
+        std::vector<uint8_t> input = pcm(signal, SILKV3_SAMPLE_RATE, 1, seconds);
+        std::vector<uint8_t> output;
+        if (silk_encode(input.data(), static_cast<int>(input.size()), collect, &output) != 0) return {};
+        return output;
+    }
+
+    const char* audio_format_name(AudioFormat format) {
+        switch (format) {
+            case AudioFormat::Wav: return "wav";
+            case AudioFormat::Flac: return "flac";
+            case AudioFormat::M4aAac: return "m4a_aac";
+            case AudioFormat::Mp2: return "mp2";
+        }
+        return "unknown";
+    }
+
+    std::vector<uint8_t> audio(AudioFormat format, Signal signal, double seconds) {
+        const char* muxer = "wav";
+        AVCodecID codec_id = AV_CODEC_ID_PCM_S16LE;
+        int sample_rate = 44100;
+        switch (format) {
+            case AudioFormat::Wav: break;
+            case AudioFormat::Flac: muxer = "flac"; codec_id = AV_CODEC_ID_FLAC; break;
+            case AudioFormat::M4aAac: muxer = "ipod"; codec_id = AV_CODEC_ID_AAC; break;
+            case AudioFormat::Mp2: muxer = "mp2"; codec_id = AV_CODEC_ID_MP2; sample_rate = 24000; break;
+        }
+
+        const AVCodec* codec = avcodec_find_encoder(codec_id);
+        Muxer mux;
+        const bool opened = mux.open(muxer, codec, [&](AVCodecContext* encoder) {
+            encoder->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+            encoder->sample_rate = sample_rate;
+            encoder->channel_layout = AV_CH_LAYOUT_STEREO;
+            encoder->channels = 2;
+            encoder->bit_rate = 128000;
+            encoder->time_base = { 1, sample_rate };
+        });
+        if (!opened) return {};
+
+        AVCodecContext* encoder = mux.context();
+        AVFrame* frame = av_frame_alloc();
+        frame->format = encoder->sample_fmt;
+        frame->channel_layout = encoder->channel_layout;
+        frame->channels = encoder->channels;
+        frame->sample_rate = encoder->sample_rate;
+        frame->nb_samples = encoder->frame_size > 0 ? encoder->frame_size : 1024;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            av_frame_free(&frame);
+            return {};
+        }
+
+        Generator generator = { signal, sample_rate };
+        const auto total = static_cast<int64_t>(sample_rate * seconds);
+        bool ok = true;
+        for (int64_t first = 0; ok && first < total; first += frame->nb_samples) {
+            ok = av_frame_make_writable(frame) >= 0;
+            fill_audio(frame, generator, first);
+            frame->pts = first;
+            ok = ok && mux.write(frame);
+        }
+        av_frame_free(&frame);
+
+        return ok ? mux.finish() : std::vector<uint8_t>();
+    }
+
+    const char* video_format_name(VideoFormat format) {
+        switch (format) {
+            case VideoFormat::Mp4Mpeg4: return "mp4_mpeg4";
+            case VideoFormat::AviMjpeg: return "avi_mjpeg";
+        }
+        return "unknown";
+    }
+
+    std::vector<uint8_t> video(VideoFormat format, int width, int height, double seconds) {
+        constexpr int fps = 25;
+        const bool mjpeg = format == VideoFormat::AviMjpeg;
+        const AVCodec* codec = avcodec_find_encoder(mjpeg ? AV_CODEC_ID_MJPEG : AV_CODEC_ID_MPEG4);
+
+        Muxer mux;
+        const bool opened = mux.open(mjpeg ? "avi" : "mp4", codec, [&](AVCodecContext* encoder) {
+            encoder->width = width;
+            encoder->height = height;
+            encoder->pix_fmt = mjpeg ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+            encoder->time_base = { 1, fps };
+            encoder->framerate = { fps, 1 };
+            encoder->gop_size = fps;
+            if (mjpeg) {
+                encoder->flags |= AV_CODEC_FLAG_QSCALE;
+                encoder->global_quality = FF_QP2LAMBDA * 5;
+            } else {
+                encoder->bit_rate = static_cast<int64_t>(width) * height * 4;
+            }
+        });
+        if (!opened) return {};
+
+        AVCodecContext* encoder = mux.context();
+        AVFrame* frame = av_frame_alloc();
+        frame->format = encoder->pix_fmt;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            av_frame_free(&frame);
+            return {};
+        }
+
+        const auto frames = static_cast<int>(seconds * fps);
+        bool ok = true;
+        for (int i = 0; ok && i < frames; i++) {
+            ok = av_frame_make_writable(frame) >= 0;
+            fill_video(frame, i);
+            frame->pts = i;
+            frame->quality = encoder->global_quality;
+            ok = ok && mux.write(frame);
+        }
+        av_frame_free(&frame);
+
+        return ok ? mux.finish() : std::vector<uint8_t>();
+    }
+}
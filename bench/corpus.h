@@ -0,0 +1,37 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_BENCH_CORPUS_H
+#define LAGRANGECODEC_BENCH_CORPUS_H
+
+#include <cstdint>
+#include <vector>
+
+// Synthetic inputs for the benchmarks, generated in memory so the suite needs no data files.
+// Every generator is deterministic, the same arguments always give the same bytes.
+namespace corpus {
+    enum class Signal { Sine, Noise };
+
+    // Interleaved little endian 16 bit PCM
+    std::vector<uint8_t> pcm(Signal signal, int sample_rate, int channels, double seconds);
+
+    // A #!SILK_V3 stream of 24 kHz mono PCM
+    std::vector<uint8_t> silk(Signal signal, double seconds);
+
+    enum class AudioFormat { Wav, Flac, M4aAac, Mp2 };
+
+    // 44.1 kHz stereo (24 kHz for mp2) encoded with the FFmpeg native encoder, empty if it is missing
+    std::vector<uint8_t> audio(AudioFormat format, Signal signal, double seconds);
+
+    const char* audio_format_name(AudioFormat format);
+
+    enum class VideoFormat { Mp4Mpeg4, AviMjpeg };
+
+    // Moving gradient at 25 fps with a keyframe every second, empty if the encoder is missing
+    std::vector<uint8_t> video(VideoFormat format, int width, int height, double seconds);
+
+    const char* video_format_name(VideoFormat format);
+}
+
+#endif //LAGRANGECODEC_BENCH_CORPUS_H
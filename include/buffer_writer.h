@@ -0,0 +1,40 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_BUFFER_WRITER_H
+#define LAGRANGECODEC_BUFFER_WRITER_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "common.h"
+
+// Write cursor over the caller's output buffer, used as the userdata of a cb_codec
+struct BufferWriter {
+    uint8_t* data;
+    int64_t capacity;
+    int64_t size;
+    bool overflow; // Something didn't fit, everything after it is dropped
+};
+
+inline void buffer_writer_write(void* userdata, const uint8_t* p, int len) {
+    auto* writer = static_cast<BufferWriter*>(userdata);
+    if (writer->overflow || len > writer->capacity - writer->size) {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->data + writer->size, p, len);
+    writer->size += len;
+}
+
+// Maps the status of the call that wrote through the writer to the bytes written or a LAGRANGE_ERROR
+inline int buffer_writer_result(const BufferWriter& writer, int status) {
+    if (status == LAGRANGE_ERROR_TIMEOUT || status == LAGRANGE_ERROR_CANCELLED) return status;
+    if (status != 0) return LAGRANGE_ERROR_FAILED;
+    if (writer.overflow) return LAGRANGE_ERROR_BUFFER_TOO_SMALL;
+    return static_cast<int>(writer.size);
+}
+
+#endif //LAGRANGECODEC_BUFFER_WRITER_H
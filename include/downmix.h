@@ -0,0 +1,15 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_DOWNMIX_H
+#define LAGRANGECODEC_DOWNMIX_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Averages interleaved little endian 16 bit stereo into mono, (L + R) >> 1 for every sample.
+// Neither pointer needs to be aligned. Uses SSE2 or NEON where the target has it.
+void downmix_stereo(const uint8_t* in, uint8_t* out, size_t samples);
+
+#endif //LAGRANGECODEC_DOWNMIX_H
@@ -0,0 +1,144 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_INSTRUMENT_H
+#define LAGRANGECODEC_INSTRUMENT_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "cancel.h"
+#include "stats.h"
+
+// Everything that happens at the boundary of an exported call: stats, trace spans and limits
+
+// LagrangeStatsFlags set by lagrange_stats_enable, and the number of threads attached to a LagrangeCallStats
+extern std::atomic<int> stats_flags;
+extern std::atomic<int> stats_attached;
+
+inline bool stats_active() {
+    return stats_flags.load(std::memory_order_relaxed) != 0 || stats_attached.load(std::memory_order_relaxed) != 0;
+}
+
+enum StatsCounter {
+    STATS_BYTES_IN,
+    STATS_BYTES_OUT,
+    STATS_FRAMES,
+    STATS_PACKETS,
+};
+
+int64_t stats_now_ns();
+void stats_record_stage(LagrangeStage stage, int64_t start_ns, int64_t end_ns);
+void stats_add(StatsCounter counter, int64_t n);
+
+inline void stats_count(StatsCounter counter, int64_t n) {
+    if (stats_active()) stats_add(counter, n);
+}
+
+// Times its own lifetime as one span of stage
+class StageTimer {
+public:
+    explicit StageTimer(LagrangeStage stage) : stage(stage), start(stats_active() ? stats_now_ns() : 0) {}
+    ~StageTimer() {
+        if (start) stats_record_stage(stage, start, stats_now_ns());
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    LagrangeStage stage;
+    int64_t start;
+};
+
+// Deadline and cancel token of one call, armed from the thread's limits when its outermost CallScope opens
+struct CallLimits {
+    int64_t deadline_ns = 0; // On the stats_now_ns clock, 0 for none
+    const LagrangeCancelToken* cancel = nullptr;
+    std::atomic<int> stopped { 0 }; // LAGRANGE_ERROR_TIMEOUT or LAGRANGE_ERROR_CANCELLED once tripped
+};
+
+// Limits of the call running on this thread, null when it has none
+extern thread_local CallLimits* active_limits;
+
+// Trips limits once the deadline passed or the token was cancelled. Implemented in cancel.cpp.
+int call_limits_check(CallLimits& limits);
+
+// 0 while the call may go on, otherwise LAGRANGE_ERROR_TIMEOUT or LAGRANGE_ERROR_CANCELLED
+inline int call_interrupted() {
+    CallLimits* limits = active_limits;
+    return limits ? call_limits_check(*limits) : 0;
+}
+
+// Limits for the calls made on this thread, timeout_ns is per call and deadline_ns absolute, 0 for none
+struct ThreadLimits {
+    int64_t timeout_ns;
+    int64_t deadline_ns;
+    const LagrangeCancelToken* cancel;
+};
+
+// Returns the limits that applied before
+ThreadLimits set_thread_limits(const ThreadLimits& limits);
+
+// Arms limits from the thread's limits, false when the thread has none
+bool call_limits_arm(CallLimits& limits);
+
+// The stats and limits of a call, handed to the threads that work on its behalf
+struct CallContext {
+    LagrangeCallStats* stats;
+    CallLimits* limits;
+};
+
+CallContext call_context();
+
+// Makes a worker thread report to and stop with the call it works for, for as long as it lives
+class CallAdopt {
+public:
+    explicit CallAdopt(const CallContext& context);
+    ~CallAdopt();
+
+    CallAdopt(const CallAdopt&) = delete;
+    CallAdopt& operator=(const CallAdopt&) = delete;
+
+private:
+    LagrangeCallStats* previous_stats;
+    CallLimits* previous_limits;
+};
+
+// Span of an exported call. Only the outermost one on a thread counts, so a call built on another
+// one is reported once, and only that one applies the thread's limits. A call is counted as failed
+// unless result() sees 0, result() turns the status of a call stopped by its limits into their error.
+class CallScope {
+public:
+    explicit CallScope(const char* name);
+    ~CallScope();
+
+    CallScope(const CallScope&) = delete;
+    CallScope& operator=(const CallScope&) = delete;
+
+    // Routes the output through the scope, so it is counted as bytesOut
+    void wrap_output(cb_codec*& callback, void*& userdata);
+    void add_output(int64_t bytes) { bytes_out += bytes; }
+
+    int result(int ret) {
+        const int stopped = outermost ? limits.stopped.load() : 0;
+        failed = ret != 0 || stopped != 0;
+        return stopped != 0 ? stopped : ret;
+    }
+
+private:
+    static void count_output(void* userdata, const uint8_t* p, int len);
+
+    const char* name;
+    int64_t start = 0; // 0 when the scope is nested or stats are off
+    int64_t allocations = 0;
+    int64_t bytes_out = 0;
+    bool failed = true;
+    bool outermost = false;
+    CallLimits limits;
+    cb_codec* callback = nullptr;
+    void* userdata = nullptr;
+};
+
+#endif //LAGRANGECODEC_INSTRUMENT_H
@@ -0,0 +1,39 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_LOGGER_H
+#define LAGRANGECODEC_LOGGER_H
+
+#include <atomic>
+
+#include "log.h"
+
+// Messages above this level are compiled out, set through LAGRANGECODEC_LOG_MAX_LEVEL in CMake
+#ifndef LAGRANGE_LOG_MAX_LEVEL
+#define LAGRANGE_LOG_MAX_LEVEL LAGRANGE_LOG_DEBUG
+#endif
+
+// Runtime level from lagrange_set_log_callback, checked before anything is formatted
+extern std::atomic<int> lagrange_log_level;
+
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+void log_message(int level, const char* format, ...);
+
+#define LAGRANGE_LOG(level, ...)                                                      \
+    do {                                                                              \
+        if constexpr ((level) <= LAGRANGE_LOG_MAX_LEVEL) {                            \
+            if ((level) <= lagrange_log_level.load(std::memory_order_relaxed)) {               \
+                log_message((level), __VA_ARGS__);                                    \
+            }                                                                         \
+        }                                                                             \
+    } while (0)
+
+#define LOG_ERROR(...) LAGRANGE_LOG(LAGRANGE_LOG_ERROR, __VA_ARGS__)
+#define LOG_WARNING(...) LAGRANGE_LOG(LAGRANGE_LOG_WARNING, __VA_ARGS__)
+#define LOG_INFO(...) LAGRANGE_LOG(LAGRANGE_LOG_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LAGRANGE_LOG(LAGRANGE_LOG_DEBUG, __VA_ARGS__)
+
+#endif //LAGRANGECODEC_LOGGER_H
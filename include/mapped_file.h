@@ -0,0 +1,49 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_MAPPED_FILE_H
+#define LAGRANGECODEC_MAPPED_FILE_H
+
+#include <climits>
+#include <cstdint>
+
+#include "logger.h"
+
+// Read only view of a whole file, served from the page cache without a heap copy
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // sequential hints the kernel to read ahead and drop pages behind the reader
+    bool open(const char* path, bool sequential);
+    void close();
+
+    // Null for an empty file
+    uint8_t* data() const { return view; }
+    int64_t size() const { return length; }
+
+private:
+    uint8_t* view = nullptr;
+    int64_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+// Maps the input of a *_file entry point, which hands it on with an int length
+inline bool map_input(MappedFile& file, const char* path, bool sequential) {
+    if (!path || !file.open(path, sequential)) return false;
+    if (file.size() > INT_MAX) {
+        LOG_ERROR("%s is too large", path);
+        return false;
+    }
+    return true;
+}
+
+#endif //LAGRANGECODEC_MAPPED_FILE_H
@@ -8,9 +8,63 @@
 #define AUDIO_CPP_H
 
 #include "common.h"
+#include "probe.h"
+#include "silk.h"
 
 constexpr int SILKV3_SAMPLE_RATE = 24000;
 
 EXPORT int audio_to_pcm(uint8_t* audio_data, int data_len, cb_codec callback, void *userdata);
 
+// Output chunking for audio_to_pcm_ex, the callback gets full chunks and one shorter tail at the end.
+// With both fields set the smaller chunk wins, with neither every decoded frame is passed through.
+struct AudioToPcmOptions {
+    int chunkMs; // Emit every N ms of 24 kHz mono PCM
+    int chunkBytes; // Emit whenever K bytes are buffered
+    const LagrangeProbeOptions* probe; // Null uses the ones from lagrange_set_probe_options
+};
+
+EXPORT int audio_to_pcm_ex(uint8_t* audio_data, int data_len, const AudioToPcmOptions* options,
+                           cb_codec callback, void *userdata);
+
+EXPORT int audio_to_pcm_io(const LagrangeIoSource* source, cb_codec callback, void *userdata);
+
+// Reads a UTF-8 path through a memory mapping instead of a buffer, options may be null
+EXPORT int audio_to_pcm_file(const char* path, const AudioToPcmOptions* options, cb_codec callback, void *userdata);
+
+// Upper bound of the PCM audio_to_pcm produces, from the probed duration. probe may be null.
+// Returns LAGRANGE_ERROR_FAILED when the container reports no duration (raw or streamed formats) or only
+// one guessed from the bitrate (e.g. VBR MP3 without a Xing header): there is no reliable bound then, and
+// the caller has to use the callback API (audio_to_pcm_ex) instead.
+EXPORT int audio_to_pcm_max_output_size(uint8_t* audio_data, int data_len, const LagrangeProbeOptions* probe);
+
+// Decodes into the caller's buffer, returns the bytes written or LAGRANGE_ERROR_BUFFER_TOO_SMALL / _FAILED
+EXPORT int audio_to_pcm_into(uint8_t* audio_data, int data_len, const AudioToPcmOptions* options,
+                             uint8_t* out, int out_capacity);
+
+constexpr int AUDIO_TO_SILK_RING_BYTES = 64 * 1024; // About 1.3 s of 24 kHz mono PCM
+
+constexpr int AUDIO_TO_SILK_SILENCE_DB = -50; // 20 ms frames quieter than this (RMS, dBFS) are silence
+constexpr int AUDIO_TO_SILK_MIN_SILENCE_MS = 300;
+
+struct AudioToSilkOptions {
+    int pipelined; // Decode on a worker thread and encode on the calling thread
+    int ringBufferBytes; // Bound of the PCM queue between the two threads, 0 for AUDIO_TO_SILK_RING_BYTES
+    const SilkEncoderOptions* encoder; // Null for the silk_encode defaults, the input rate and channels are set here
+    int trimSilence; // Drop leading and trailing silence and enable DTX for the pauses in between
+    int silenceThresholdDb; // Negative dBFS, 0 for AUDIO_TO_SILK_SILENCE_DB
+    int minSilenceMs; // Shorter leading or trailing silence is kept, 0 for AUDIO_TO_SILK_MIN_SILENCE_MS
+    int64_t* trimmedMs; // Receives the ms of silence removed when trimming, may be null
+};
+
+// Decodes any audio straight into the SILK encoder, the PCM is never materialised as a whole.
+// options may be null. Returns -1 on FFmpeg errors and 1 on SILK errors like the split calls.
+EXPORT int audio_to_silk(uint8_t* audio_data, int data_len, const AudioToSilkOptions* options,
+                         cb_codec callback, void *userdata);
+
+EXPORT int audio_to_silk_io(const LagrangeIoSource* source, const AudioToSilkOptions* options,
+                            cb_codec callback, void *userdata);
+
+EXPORT int audio_to_silk_file(const char* path, const AudioToSilkOptions* options,
+                              cb_codec callback, void *userdata);
+
 #endif //AUDIO_CPP_H
\ No newline at end of file
@@ -0,0 +1,53 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef AWAITABLE_H
+#define AWAITABLE_H
+
+#include <coroutine>
+
+#include "batch.h"
+
+namespace lagrange {
+    // co_await lagrange::submit(job) runs the job through lagrange_submit and yields its status,
+    // or LAGRANGE_ERROR_BUSY when the queue is full. The coroutine resumes on the pool thread that
+    // ran the job, so hop back to your own executor before doing more than a little work there.
+    class JobAwaitable {
+    public:
+        explicit JobAwaitable(const LagrangeJob& job) : state { job } {}
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) noexcept {
+            state.handle = handle;
+            const int ret = lagrange_submit(&state.job, on_complete);
+            if (ret != 0) {
+                state.rejected = ret;
+                return false; // Resume right away, await_resume reports it
+            }
+            return true; // The job may have completed already, so nothing is touched past this point
+        }
+
+        int await_resume() const noexcept { return state.rejected != 0 ? state.rejected : state.job.status; }
+
+    private:
+        struct State {
+            LagrangeJob job; // First, so the completion finds its State from the job pointer
+            std::coroutine_handle<> handle;
+            int rejected = 0;
+        };
+
+        static void on_complete(LagrangeJob* job) {
+            reinterpret_cast<State*>(job)->handle.resume();
+        }
+
+        State state;
+    };
+
+    inline JobAwaitable submit(const LagrangeJob& job) {
+        return JobAwaitable(job);
+    }
+}
+
+#endif //AWAITABLE_H
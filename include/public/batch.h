@@ -0,0 +1,62 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cancel.h"
+#include "common.h"
+
+// Every codec call only touches its own state, so they may run concurrently from any number of
+// threads. The batch API runs them on a library owned work stealing pool instead.
+
+enum LagrangeJobType {
+    LAGRANGE_JOB_SILK_ENCODE,
+    LAGRANGE_JOB_SILK_DECODE,
+    LAGRANGE_JOB_AUDIO_TO_PCM,
+    LAGRANGE_JOB_AUDIO_TO_SILK,
+    LAGRANGE_JOB_VIDEO_FIRST_FRAME, // The callback gets the PNG in a single call
+};
+
+struct LagrangeJob {
+    int type; // LagrangeJobType
+    uint8_t* data;
+    int dataLen;
+    cb_codec* callback; // Invoked on the pool thread that runs the job
+    void* userdata;
+    int status; // Return code of the matching call, written once the job has finished
+    int64_t timeoutMs; // Counted from lagrange_submit or lagrange_batch_run, or the start of lagrange_job_run, 0 for none
+    LagrangeCancelToken* cancel; // Null for none. Without either the job runs under the thread's lagrange_set_call_limits.
+};
+
+// Jobs lagrange_submit accepts by default before it signals LAGRANGE_ERROR_BUSY
+#define LAGRANGE_DEFAULT_MAX_QUEUED_JOBS 1024
+
+struct LagrangePoolOptions {
+    int threadCount; // 0 for one thread per core
+    int pinThreads; // Pin worker i to core i % core count, where the platform supports it
+    int maxQueuedJobs; // Submitted jobs that may be queued or running at once, 0 for LAGRANGE_DEFAULT_MAX_QUEUED_JOBS
+};
+
+// Replaces the shared pool, batches that are already running finish on the old one
+EXPORT int lagrange_pool_configure(const LagrangePoolOptions* options);
+
+// Runs a single job on the calling thread
+EXPORT int lagrange_job_run(LagrangeJob* job);
+
+// Runs all jobs on the shared pool and the calling thread and blocks until they are done, returns the number
+// of failed jobs. Safe to call from a pool thread, the caller then works through the jobs itself if need be.
+EXPORT int lagrange_batch_run(LagrangeJob* jobs, int count);
+
+// Called on the pool thread that ran the job, once job->status is set. The job may be freed or resubmitted from here.
+typedef void (cb_job_complete)(LagrangeJob* job);
+
+// Queues the job on the shared pool and returns right away, job must stay valid until on_complete (may be null)
+// runs. Returns 0 when queued, or LAGRANGE_ERROR_BUSY without taking the job when maxQueuedJobs are in flight.
+EXPORT int lagrange_submit(LagrangeJob* job, cb_job_complete* on_complete);
+
+// Jobs submitted and not completed yet
+EXPORT int lagrange_jobs_in_flight(void);
+
+#endif //BATCH_H
@@ -0,0 +1,34 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef CANCEL_H
+#define CANCEL_H
+
+#include "common.h"
+
+// Shared flag that stops every call watching it, may be triggered from any thread
+struct LagrangeCancelToken;
+
+EXPORT LagrangeCancelToken* lagrange_cancel_token_create(void);
+
+EXPORT void lagrange_cancel_token_cancel(LagrangeCancelToken* token);
+
+EXPORT int lagrange_cancel_token_is_cancelled(const LagrangeCancelToken* token);
+
+// Only once no call is watching the token anymore
+EXPORT void lagrange_cancel_token_destroy(LagrangeCancelToken* token);
+
+// Stops a call between packets and SILK frames, and inside FFmpeg's probing and reading through
+// AVIOInterruptCB. The call then fails with LAGRANGE_ERROR_TIMEOUT or LAGRANGE_ERROR_CANCELLED,
+// output already passed to the callback stays valid but is incomplete.
+// Streaming encoder and decoder objects are not covered, their caller decides when to stop pushing.
+struct LagrangeCallLimits {
+    int64_t timeoutMs; // Per call, counted from its start, 0 for none
+    LagrangeCancelToken* cancel; // Null for none
+};
+
+// Applies to every call made on this thread from now on, null lifts the limits
+EXPORT void lagrange_set_call_limits(const LagrangeCallLimits* limits);
+
+#endif //CANCEL_H
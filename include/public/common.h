@@ -9,6 +9,29 @@
 
 typedef void (cb_codec)(void* userdata, const uint8_t* p, int len);
 
+// Negative results of the calls that return a byte count. TIMEOUT and CANCELLED replace the
+// regular failure code (-1 or 1) of every call that was stopped by its limits.
+#define LAGRANGE_ERROR_FAILED (-1)
+#define LAGRANGE_ERROR_BUFFER_TOO_SMALL (-2)
+#define LAGRANGE_ERROR_BUSY (-3) // lagrange_submit queue is full, retry once jobs complete
+#define LAGRANGE_ERROR_TIMEOUT (-4) // The call ran past its deadline, see cancel.h
+#define LAGRANGE_ERROR_CANCELLED (-5) // The cancel token of the call was triggered
+
+typedef int (cb_io_read)(void* userdata, uint8_t* buf, int buf_size);
+typedef int64_t (cb_io_seek)(void* userdata, int64_t offset, int whence);
+typedef int64_t (cb_io_size)(void* userdata);
+
+// Pull based input for the *_io entry points, so the caller never has to hold the whole file.
+// read returns the number of bytes read, 0 at the end of the input and a negative value on error.
+// seek takes SEEK_SET / SEEK_CUR / SEEK_END and returns the new position (negative on error).
+// seek and size may be null when the source can't seek or doesn't know its size.
+struct LagrangeIoSource {
+    cb_io_read* read;
+    cb_io_seek* seek;
+    cb_io_size* size;
+    void* userdata;
+};
+
 #ifdef _WIN32
 #  if defined(LAGRANGECODEC_SHARED_BUILD)
 #    define LAGRANGECODEC_API __declspec(dllexport)
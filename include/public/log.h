@@ -0,0 +1,28 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LOG_H
+#define LOG_H
+
+#include "common.h"
+
+enum LagrangeLogLevel {
+    LAGRANGE_LOG_QUIET = -1,
+    LAGRANGE_LOG_ERROR = 0,
+    LAGRANGE_LOG_WARNING = 1,
+    LAGRANGE_LOG_INFO = 2,
+    LAGRANGE_LOG_DEBUG = 3,
+};
+
+// message is one line without the trailing newline, only valid during the call.
+// May be called from any thread, including the FFmpeg and thread pool workers.
+typedef void (cb_log)(void* userdata, int level, const char* message);
+
+// Messages of the library and of FFmpeg (av_log) above level are dropped before they are formatted.
+// A null callback restores the default sink, which writes to stderr. Defaults to LAGRANGE_LOG_ERROR.
+// FFmpeg's own log callback is left to the host until this is first called, from then on av_log goes
+// to the sink too. The previous callback may still finish a message on another thread after this returns.
+EXPORT void lagrange_set_log_callback(int level, cb_log* callback, void* userdata);
+
+#endif //LOG_H
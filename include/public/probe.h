@@ -0,0 +1,21 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "common.h"
+
+// Bounds the work FFmpeg does before the first useful packet. Zero fields keep FFmpeg's defaults.
+struct LagrangeProbeOptions {
+    int64_t probeSize; // Bytes read while probing, at least 32
+    int64_t analyzeDurationUs; // Media analysed by avformat_find_stream_info
+    int skipStreamInfo; // Skip avformat_find_stream_info when the container header is already complete
+    const char* formatHint; // Demuxer name such as "mp4" or "mp3", skips format detection
+};
+
+// Sets the options used by calls that don't pass their own, null restores the defaults
+EXPORT void lagrange_set_probe_options(const LagrangeProbeOptions* options);
+
+#endif //PROBE_H
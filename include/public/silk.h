@@ -29,6 +29,142 @@ inline void swap_endian(SKP_int16 vec[], SKP_int len) {
 
 EXPORT int silk_decode(uint8_t* silk_data, int len, cb_codec callback, void* userdata);
 
+EXPORT int silk_decode_io(const LagrangeIoSource* source, cb_codec callback, void* userdata);
+
+// Reads the file through a sequential memory mapping instead of a buffer, path is UTF-8
+EXPORT int silk_decode_file(const char* path, cb_codec callback, void* userdata);
+
+struct SilkProbeInfo {
+    int packets;
+    int64_t durationMs;
+    int averageBitrate; // Payload bits per second
+    int truncated; // The data ends inside a packet
+    int corrupt; // An invalid length prefix or packet TOC stopped the walk early
+};
+
+// Walks the packet chain after the header without running the decoder, the frame count of each
+// packet comes from its TOC. Returns 1 only when the header is missing, info covers the valid prefix.
+EXPORT int silk_probe(const uint8_t* silk_data, int len, SilkProbeInfo* info);
+
+EXPORT int silk_probe_file(const char* path, SilkProbeInfo* info);
+
+// Upper bound of the PCM silk_decode produces for this stream, from the packet TOCs
+EXPORT int silk_decode_max_output_size(const uint8_t* silk_data, int len);
+
+// Decodes into the caller's buffer, returns the bytes written or LAGRANGE_ERROR_BUFFER_TOO_SMALL / _FAILED
+EXPORT int silk_decode_into(uint8_t* silk_data, int len, uint8_t* out, int out_capacity);
+
+// Decodes only the packets covering [start_ms, end_ms) plus a short pre-roll, end_ms <= 0 means
+// the end of the stream. The PCM passed to the callback is trimmed to the range exactly.
+EXPORT int silk_decode_range(uint8_t* silk_data, int len, int64_t start_ms, int64_t end_ms,
+                             cb_codec callback, void* userdata);
+
 EXPORT int silk_encode(uint8_t* pcm_data, int len, cb_codec callback, void* userdata);
 
+// Incremental decoder, the SILK file can be pushed in byte chunks of any size and the PCM of
+// every packet is passed to the callback once the LBRR delay queue (MAX_LBRR_DELAY packets) is filled.
+struct SilkDecoder;
+
+EXPORT SilkDecoder* silk_decoder_create(cb_codec callback, void* userdata);
+
+EXPORT int silk_decoder_push(SilkDecoder* decoder, const uint8_t* silk_data, int len);
+
+// Pushes one already framed packet (no header, no length prefix), a zero length marks a lost packet
+EXPORT int silk_decoder_push_packet(SilkDecoder* decoder, const uint8_t* packet, int len);
+
+// Decodes the packets still waiting in the queue, a truncated trailing packet is dropped.
+// Fails if the header was never read completely.
+EXPORT int silk_decoder_flush(SilkDecoder* decoder);
+
+EXPORT void silk_decoder_destroy(SilkDecoder* decoder);
+
+// Incremental encoder, PCM can be pushed in chunks of any size and every packet is passed to
+// the callback as soon as its 20 ms frame is complete, length prefix and payload in one call.
+// The SILK header is emitted by create.
+struct SilkEncoder;
+
+EXPORT SilkEncoder* silk_encoder_create(cb_codec callback, void* userdata);
+
+EXPORT int silk_encoder_push(SilkEncoder* encoder, const uint8_t* pcm_data, int len);
+
+// Pads the buffered partial frame (if any) with silence and encodes it
+EXPORT int silk_encoder_flush(SilkEncoder* encoder);
+
+EXPORT void silk_encoder_destroy(SilkEncoder* encoder);
+
+// Pool of initialised SKP encoder / decoder states that are reset between uses instead of being
+// reallocated. Either pass a pool explicitly to the *_pooled calls, or enable the global pool so
+// the plain calls use it too. A null pool allocates as usual. All pool functions are thread safe.
+struct SilkStatePool;
+
+struct SilkPoolStats {
+    int64_t encoderHits;
+    int64_t encoderMisses;
+    int64_t decoderHits;
+    int64_t decoderMisses;
+    int idleEncoders;
+    int idleDecoders;
+};
+
+// capacity is the number of idle states kept per kind, 0 for the default (64)
+EXPORT SilkStatePool* silk_pool_create(int capacity);
+
+// All encoders and decoders created from the pool must be destroyed first
+EXPORT void silk_pool_destroy(SilkStatePool* pool);
+
+EXPORT void silk_pool_set_global(int enabled);
+
+// A null pool reports the global one
+EXPORT void silk_pool_get_stats(SilkStatePool* pool, SilkPoolStats* stats);
+
+EXPORT SilkEncoder* silk_encoder_create_pooled(SilkStatePool* pool, cb_codec callback, void* userdata);
+
+EXPORT SilkDecoder* silk_decoder_create_pooled(SilkStatePool* pool, cb_codec callback, void* userdata);
+
+EXPORT int silk_encode_pooled(SilkStatePool* pool, uint8_t* pcm_data, int len, cb_codec callback, void* userdata);
+
+EXPORT int silk_decode_pooled(SilkStatePool* pool, uint8_t* silk_data, int len, cb_codec callback, void* userdata);
+
+// Encoder settings, see SKP_SILK_SDK_EncControlStruct. A null options pointer keeps the defaults
+// silk_encode uses: complexity 2, 24 kbps, 20 ms packets, no FEC / DTX, 24 kHz internal rate.
+struct SilkEncoderOptions {
+    int complexity; // 0 (fastest) to 2 (best), only 0 when built with LOW_COMPLEXITY_ONLY
+    int bitRate; // Target bitrate in bps
+    int packetSize; // Packet duration in ms, 20 to 100 in steps of 20
+    int useInBandFEC;
+    int useDTX;
+    int maxInternalSampleRate; // 8000, 12000, 16000 or 24000 Hz, 0 for 24000
+    int packetLossPercentage; // Expected loss, only used to size the in-band FEC
+    int sampleRate; // Of the input PCM, 8000, 12000, 16000, 24000, 32000, 44100 or 48000 Hz, 0 for 24000
+    int channels; // Of the input PCM, 1 or 2 (interleaved, downmixed to mono), 0 for mono
+};
+
+// Fills options with the named preset: "default" (as silk_encode), "fast", "balanced" or "quality".
+// Returns 1 for an unknown name.
+EXPORT int silk_encoder_options_preset(const char* name, SilkEncoderOptions* options);
+
+// Returns null when options are out of range
+EXPORT SilkEncoder* silk_encoder_create_ex(const SilkEncoderOptions* options, cb_codec callback, void* userdata);
+
+EXPORT int silk_encode_ex(uint8_t* pcm_data, int len, const SilkEncoderOptions* options,
+                          cb_codec callback, void* userdata);
+
+// Encodes the PCM file through a memory mapping, options may be null
+EXPORT int silk_encode_file(const char* path, const SilkEncoderOptions* options, cb_codec callback, void* userdata);
+
+// Upper bound of the stream silk_encode_ex produces for len bytes of PCM, options may be null.
+// LAGRANGE_ERROR_FAILED for options silk_encoder_create_ex would reject.
+EXPORT int silk_encode_max_output_size(int len, const SilkEncoderOptions* options);
+
+// Encodes into the caller's buffer, returns the bytes written or LAGRANGE_ERROR_BUFFER_TOO_SMALL / _FAILED
+EXPORT int silk_encode_into(uint8_t* pcm_data, int len, const SilkEncoderOptions* options,
+                            uint8_t* out, int out_capacity);
+
+// Splits long PCM into segments at packet boundaries and encodes them concurrently on the shared pool,
+// each with its own encoder that first runs over 200 ms of the preceding audio to converge. The packets
+// are stitched into one regular #!SILK_V3 stream. segments 0 uses one per pool thread, inputs shorter
+// than about 10 s per segment fall back to silk_encode_ex. options may be null.
+EXPORT int silk_encode_parallel(uint8_t* pcm_data, int len, const SilkEncoderOptions* options, int segments,
+                                cb_codec callback, void* userdata);
+
 #endif //SILK_H
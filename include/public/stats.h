@@ -0,0 +1,83 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "common.h"
+
+// Instrumentation is off by default and then costs a couple of relaxed loads per stage
+
+enum LagrangeStage {
+    LAGRANGE_STAGE_PROBE, // avformat_open_input and avformat_find_stream_info
+    LAGRANGE_STAGE_DEMUX, // av_read_frame
+    LAGRANGE_STAGE_DECODE, // FFmpeg audio and video decoding
+    LAGRANGE_STAGE_RESAMPLE, // swr_convert
+    LAGRANGE_STAGE_SILK_ENCODE, // SKP_Silk_SDK_Encode
+    LAGRANGE_STAGE_SILK_DECODE, // SKP_Silk_SDK_Decode
+    LAGRANGE_STAGE_SCALE, // sws_scale
+    LAGRANGE_STAGE_IMAGE_ENCODE, // PNG, JPEG or WebP encoding
+    LAGRANGE_STAGE_COUNT
+};
+
+// Filled by the calls made on a thread while it is attached with lagrange_stats_attach.
+// Work a call hands to other threads (pipelined audio_to_silk, silk_encode_parallel) is included,
+// so stage times are summed over threads and may exceed the wall time of the call.
+struct LagrangeCallStats {
+    int64_t calls; // Top level calls, a call made from inside another one is not counted
+    int64_t totalNs; // Wall time of those calls
+    int64_t stageNs[LAGRANGE_STAGE_COUNT];
+    int64_t bytesIn;
+    int64_t bytesOut; // Passed to the callback or returned as the image
+    int64_t frames; // Decoded audio and video frames, encoded and decoded 20 ms SILK frames
+    int64_t packets; // Demuxed packets and SILK packets
+    int64_t allocations; // Reported through lagrange_stats_count_allocation on the calling thread, 0 without a hook
+};
+
+// Calls on this thread add to *stats (zero it first) until it is attached again or with null
+EXPORT void lagrange_stats_attach(LagrangeCallStats* stats);
+
+// For an allocation hook the host already has, e.g. a malloc wrapper: counts one heap allocation
+// against the call running on this thread. Takes no lock and never allocates.
+EXPORT void lagrange_stats_count_allocation(void);
+
+enum LagrangeStatsFlags {
+    LAGRANGE_STATS_AGGREGATE = 1, // Process wide counters and latency histograms
+    LAGRANGE_STATS_TRACE = 2, // Record spans for lagrange_trace_export
+};
+
+EXPORT void lagrange_stats_enable(int flags);
+
+// Bucket 0 counts durations under 1 us, bucket i those in [2^(i-1), 2^i) us, the last one everything longer
+#define LAGRANGE_STATS_BUCKETS 32
+
+struct LagrangeLatencyStats {
+    int64_t count;
+    int64_t totalNs;
+    int64_t maxNs;
+    int64_t histogram[LAGRANGE_STATS_BUCKETS];
+};
+
+struct LagrangeGlobalStats {
+    LagrangeLatencyStats calls;
+    LagrangeLatencyStats stages[LAGRANGE_STAGE_COUNT];
+    int64_t failures; // Calls that returned an error
+    int64_t bytesIn;
+    int64_t bytesOut;
+    int64_t frames;
+    int64_t packets;
+};
+
+// Snapshot of the counters collected since LAGRANGE_STATS_AGGREGATE was enabled or the last reset
+EXPORT void lagrange_stats_get(LagrangeGlobalStats* stats);
+
+// Clears the aggregate counters and the recorded trace
+EXPORT void lagrange_stats_reset(void);
+
+// Writes the recorded spans as Chrome trace event JSON (chrome://tracing, ui.perfetto.dev) through callback.
+// At most LAGRANGE_TRACE_MAX_EVENTS spans are kept, later ones are dropped. Returns 0 on success.
+#define LAGRANGE_TRACE_MAX_EVENTS (1 << 20)
+EXPORT int lagrange_trace_export(cb_codec callback, void* userdata);
+
+#endif //STATS_H
@@ -6,6 +6,7 @@
 #define VIDEO_H
 
 #include "common.h"
+#include "probe.h"
 
 #include <cstdint>
 
@@ -15,8 +16,82 @@ struct VideoInfo {
     int64_t duration;
 };
 
+enum LagrangeImageFormat {
+    LAGRANGE_IMAGE_PNG = 0,
+    LAGRANGE_IMAGE_JPEG = 1,
+    LAGRANGE_IMAGE_WEBP = 2, // Needs FFmpeg built with libwebp
+};
+
+enum LagrangeScaling {
+    LAGRANGE_SCALE_BILINEAR = 0,
+    LAGRANGE_SCALE_FAST_BILINEAR = 1,
+    LAGRANGE_SCALE_BICUBIC = 2,
+    LAGRANGE_SCALE_AREA = 3,
+    LAGRANGE_SCALE_LANCZOS = 4,
+    LAGRANGE_SCALE_POINT = 5,
+};
+
+// Same values as FF_THREAD_FRAME / FF_THREAD_SLICE
+enum LagrangeThreadType {
+    LAGRANGE_THREAD_FRAME = 1,
+    LAGRANGE_THREAD_SLICE = 2,
+};
+
+struct ThumbnailOptions {
+    int maxWidth; // Fit into maxWidth x maxHeight keeping the aspect ratio, 0 leaves the side unbounded
+    int maxHeight;
+    int scaling; // LagrangeScaling
+    int format; // LagrangeImageFormat
+    int quality; // 1-100, JPEG/WebP quality or the PNG compression effort, 0 keeps the encoder default
+    const LagrangeProbeOptions* probe; // Null uses the ones from lagrange_set_probe_options
+    int threadCount; // Decoder threads, 0 picks up to 4, always capped by video_set_thread_budget
+    int threadType; // LAGRANGE_THREAD_SLICE and/or LAGRANGE_THREAD_FRAME, 0 is slice threading
+    int fastDecode; // Decode at reduced resolution (lowres) where supported and skip the loop filter and non-ref IDCT
+};
+
+// The image is allocated with av_malloc, video_first_frame is a full size PNG thumbnail
+EXPORT int video_thumbnail(uint8_t* video_data, int data_len, const ThumbnailOptions* options, uint8_t*& out, int& out_len);
+
+EXPORT int video_thumbnail_io(const LagrangeIoSource* source, const ThumbnailOptions* options, uint8_t*& out, int& out_len);
+
+struct VideoFramesOptions {
+    const int64_t* timestampsMs; // count seek targets, null spreads count frames evenly from the start
+    int count;
+    int spriteColumns; // > 0 tiles all frames into one image with this many columns, 0 emits one image per frame
+    ThumbnailOptions thumbnail; // Size of every frame or tile, output format and probe options
+};
+
+// Decodes only the keyframe at or before each timestamp, callback gets the images in timestamp order
+EXPORT int video_frames(uint8_t* video_data, int data_len, const VideoFramesOptions* options,
+                        cb_codec callback, void* userdata);
+
+EXPORT int video_frames_io(const LagrangeIoSource* source, const VideoFramesOptions* options,
+                           cb_codec callback, void* userdata);
+
+// Caps the decoder threads of all concurrent video calls together, 0 restores the default of one per core
+EXPORT void video_set_thread_budget(int threads);
+
 EXPORT int video_first_frame(uint8_t* video_data, int data_len, uint8_t*& out, int& out_len);
 
 EXPORT int video_get_size(uint8_t* video_data, int data_len, VideoInfo& info);
 
+EXPORT int video_first_frame_io(const LagrangeIoSource* source, uint8_t*& out, int& out_len);
+
+EXPORT int video_get_size_io(const LagrangeIoSource* source, VideoInfo& info);
+
+// Same as above with per call probe options, null uses the ones from lagrange_set_probe_options
+EXPORT int video_first_frame_ex(uint8_t* video_data, int data_len, const LagrangeProbeOptions* probe,
+                                uint8_t*& out, int& out_len);
+
+EXPORT int video_get_size_ex(uint8_t* video_data, int data_len, const LagrangeProbeOptions* probe, VideoInfo& info);
+
+// Same as above, reading a UTF-8 path through a memory mapping instead of a buffer
+EXPORT int video_first_frame_file(const char* path, uint8_t*& out, int& out_len);
+
+EXPORT int video_get_size_file(const char* path, VideoInfo& info);
+
+EXPORT int video_thumbnail_file(const char* path, const ThumbnailOptions* options, uint8_t*& out, int& out_len);
+
+EXPORT int video_frames_file(const char* path, const VideoFramesOptions* options, cb_codec callback, void* userdata);
+
 #endif //VIDEO_H
@@ -0,0 +1,69 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_RING_BUFFER_H
+#define LAGRANGECODEC_RING_BUFFER_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// Bounded single producer / single consumer byte queue, the producer blocks while it is full
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity) : buffer(capacity) {}
+
+    // Blocks until everything is written, returns false if the buffer was closed meanwhile
+    bool write(const uint8_t* data, size_t len) {
+        std::unique_lock lock(mutex);
+        while (len > 0) {
+            not_full.wait(lock, [this] { return closed || size < buffer.size(); });
+            if (closed) return false;
+
+            const size_t tail = (head + size) % buffer.size();
+            const size_t n = std::min({ len, buffer.size() - size, buffer.size() - tail });
+            memcpy(buffer.data() + tail, data, n);
+            size += n;
+            data += n;
+            len -= n;
+            not_empty.notify_one();
+        }
+        return true;
+    }
+
+    // Blocks until data is available, returns 0 once the buffer is closed and drained
+    size_t read(uint8_t* data, size_t len) {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [this] { return closed || size > 0; });
+
+        const size_t n = std::min({ len, size, buffer.size() - head });
+        memcpy(data, buffer.data() + head, n);
+        head = (head + n) % buffer.size();
+        size -= n;
+        not_full.notify_one();
+        return n;
+    }
+
+    // No more writes are accepted, the reader still drains what is left
+    void close() {
+        std::lock_guard lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    std::vector<uint8_t> buffer;
+    size_t head = 0;
+    size_t size = 0;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+#endif //LAGRANGECODEC_RING_BUFFER_H
@@ -0,0 +1,60 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#ifndef LAGRANGECODEC_THREAD_POOL_H
+#define LAGRANGECODEC_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool, every worker owns a deque and steals from the others once its own is empty.
+// Tasks submitted from a worker go to that worker's deque, everything else is spread round robin.
+class ThreadPool {
+public:
+    // thread_count <= 0 picks std::thread::hardware_concurrency
+    explicit ThreadPool(int thread_count, bool pin_threads = false);
+
+    // Runs the tasks that are still queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    int size() const { return static_cast<int>(threads.size()); }
+
+    static int default_thread_count();
+
+    // Library wide pool shared by the batch API and the parallel encoders, created on first use
+    static std::shared_ptr<ThreadPool> shared();
+
+    // Replaces the shared pool, work already queued on the old one finishes there
+    static void configure_shared(int thread_count, bool pin_threads);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool try_pop(size_t index, std::function<void()>& task);
+    void run(size_t index, bool pin_thread);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> pending { 0 };
+    std::atomic<size_t> next { 0 };
+    bool stopping = false;
+};
+
+#endif //LAGRANGECODEC_THREAD_POOL_H
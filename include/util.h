@@ -5,35 +5,192 @@
 #ifndef LAGRANGECODEC_UTIL_H
 #define LAGRANGECODEC_UTIL_H
 
+#include <cstdio>
+#include <cstring>
+
+#include "common.h"
+#include "instrument.h"
+#include "logger.h"
+#include "probe.h"
+
 extern "C" {
 #include <libavformat/avio.h>
 #include <libavformat/avformat.h>
 }
 
-// REMEMBER TO FREE THE BUFFER AFTER USE BY av_free(format_context->pb->buffer);
-inline int create_format_context(uint8_t* data, int data_len, AVFormatContext** format_context) {
-    AVIOContext* avio_ctx = nullptr; // Create a custom I/O context with the raw audio data buffer
-    uint8_t* avio_buffer = nullptr;
+// Size of the AVIO scratch buffer, FFmpeg reads the input through it in chunks of this size
+constexpr int AVIO_BUFFER_SIZE = 32 * 1024;
+
+// Read cursor over the caller's buffer, the data itself is never copied
+struct MemoryReader {
+    const uint8_t* data;
+    int64_t size;
+    int64_t pos;
+};
+
+inline int memory_reader_read(void* opaque, uint8_t* buf, int buf_size) {
+    if (call_interrupted()) return AVERROR_EXIT;
+
+    auto* reader = static_cast<MemoryReader*>(opaque);
+    const int64_t remaining = reader->size - reader->pos;
+    if (remaining <= 0) return AVERROR_EOF;
+
+    const int n = static_cast<int>(FFMIN(static_cast<int64_t>(buf_size), remaining));
+    memcpy(buf, reader->data + reader->pos, n);
+    reader->pos += n;
+    stats_count(STATS_BYTES_IN, n);
+    return n;
+}
+
+inline int64_t memory_reader_seek(void* opaque, int64_t offset, int whence) {
+    auto* reader = static_cast<MemoryReader*>(opaque);
+    int64_t target;
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return reader->size;
+        case SEEK_SET: target = offset; break;
+        case SEEK_CUR: target = reader->pos + offset; break;
+        case SEEK_END: target = reader->size + offset; break;
+        default: return AVERROR(EINVAL);
+    }
+
+    if (target < 0 || target > reader->size) return AVERROR(EINVAL);
+    reader->pos = target;
+    return target;
+}
+
+// Adapts a caller supplied LagrangeIoSource to the AVIO callbacks
+inline int io_source_read(void* opaque, uint8_t* buf, int buf_size) {
+    if (call_interrupted()) return AVERROR_EXIT;
 
-    avio_buffer = static_cast<uint8_t*>(av_malloc(data_len)); // Allocate buffer for AVIOContext
+    auto* source = static_cast<LagrangeIoSource*>(opaque);
+    const int n = source->read(source->userdata, buf, buf_size);
+    if (n == 0) return AVERROR_EOF;
+    if (n < 0) return AVERROR(EIO);
+    stats_count(STATS_BYTES_IN, n);
+    return n;
+}
+
+inline int64_t io_source_seek(void* opaque, int64_t offset, int whence) {
+    auto* source = static_cast<LagrangeIoSource*>(opaque);
+    if (whence & AVSEEK_SIZE) {
+        return source->size ? source->size(source->userdata) : AVERROR(ENOSYS);
+    }
+
+    const int64_t pos = source->seek(source->userdata, offset, whence & ~AVSEEK_FORCE);
+    return pos < 0 ? AVERROR(EIO) : pos;
+}
+
+// AVIOInterruptCB, makes FFmpeg give up blocking operations such as probing once the call was stopped
+inline int interrupt_requested(void*) {
+    return call_interrupted() != 0;
+}
+
+inline void free_avio_context(AVIOContext* avio_ctx) {
+    if (!avio_ctx) return;
+    av_free(avio_ctx->opaque);
+    av_freep(&avio_ctx->buffer); // FFmpeg may have reallocated it, so free the current one
+    avio_context_free(&avio_ctx);
+}
+
+// Takes ownership of the av_malloc'ed opaque, it is released together with the AVIOContext
+inline int create_format_context(void* opaque, int (*read)(void*, uint8_t*, int),
+                                 int64_t (*seek)(void*, int64_t, int), AVFormatContext** format_context) {
+    auto* avio_buffer = static_cast<uint8_t*>(av_malloc(AVIO_BUFFER_SIZE)); // Allocate buffer for AVIOContext
     if (!avio_buffer) {
-        fprintf(stderr, "ERROR: failed to allocate memory for AVIOContext\n");
+        LOG_ERROR("failed to allocate memory for AVIOContext");
+        av_free(opaque);
         return -1;
     }
-    memcpy(avio_buffer, data, data_len);
 
-    // Allocate the AVIOContext with the custom buffer
-    avio_ctx = avio_alloc_context(avio_buffer, data_len, 0, nullptr, nullptr, nullptr, nullptr);
+    AVIOContext* avio_ctx = avio_alloc_context(avio_buffer, AVIO_BUFFER_SIZE, 0, opaque, read, nullptr, seek);
     if (!avio_ctx) {
-        fprintf(stderr, "ERROR: failed to create AVIOContext\n");
+        LOG_ERROR("failed to create AVIOContext");
+        av_free(avio_buffer);
+        av_free(opaque);
         return -1;
     }
 
     // Create format context and set the I/O context
     *format_context = avformat_alloc_context();
+    if (!*format_context) {
+        LOG_ERROR("failed to allocate format context");
+        free_avio_context(avio_ctx);
+        return -1;
+    }
     (*format_context)->pb = avio_ctx;
+    (*format_context)->interrupt_callback = { interrupt_requested, nullptr };
 
     return 0;
 }
 
-#endif //LAGRANGECODEC_UTIL_H
\ No newline at end of file
+// OPEN IT WITH open_format_context AND RELEASE IT WITH free_format_context,
+// avformat_close_input DOES NOT FREE A CUSTOM AVIOContext
+inline int create_format_context(uint8_t* data, int data_len, AVFormatContext** format_context) {
+    auto* reader = static_cast<MemoryReader*>(av_malloc(sizeof(MemoryReader)));
+    if (!reader) {
+        LOG_ERROR("failed to allocate memory reader");
+        return -1;
+    }
+    *reader = { data, data_len, 0 };
+
+    // The AVIOContext reads straight from the caller's buffer through the callbacks
+    return create_format_context(reader, memory_reader_read, memory_reader_seek, format_context);
+}
+
+// Same as above, but reads through the caller's callbacks
+inline int create_format_context(const LagrangeIoSource* source, AVFormatContext** format_context) {
+    if (!source || !source->read) {
+        return -1;
+    }
+
+    auto* copy = static_cast<LagrangeIoSource*>(av_malloc(sizeof(LagrangeIoSource)));
+    if (!copy) {
+        LOG_ERROR("failed to allocate I/O source");
+        return -1;
+    }
+    *copy = *source;
+
+    return create_format_context(copy, io_source_read, source->seek ? io_source_seek : nullptr, format_context);
+}
+
+// Opens the input of a context from create_format_context, everything is released if this fails
+inline int open_format_context(AVFormatContext** format_context, const AVInputFormat* input_format = nullptr,
+                               AVDictionary** options = nullptr) {
+    AVIOContext* avio_ctx = (*format_context)->pb;
+    const int ret = avformat_open_input(format_context, nullptr, input_format, options);
+    if (ret < 0) { // avformat_open_input has already freed the format context itself
+        free_avio_context(avio_ctx);
+    }
+    return ret;
+}
+
+// Closes the input (if it was opened) and releases the custom I/O context created above
+inline void free_format_context(AVFormatContext** format_context) {
+    if (!format_context || !*format_context) return;
+
+    AVIOContext* avio_ctx = (*format_context)->pb;
+    if ((*format_context)->iformat) {
+        avformat_close_input(format_context);
+    } else {
+        avformat_free_context(*format_context);
+        *format_context = nullptr;
+    }
+    free_avio_context(avio_ctx);
+}
+
+// av_read_frame, timed as the demux stage. Fails with AVERROR_EXIT once the call was stopped.
+inline int read_packet(AVFormatContext* format_context, AVPacket* packet) {
+    if (call_interrupted()) return AVERROR_EXIT;
+
+    StageTimer timer(LAGRANGE_STAGE_DEMUX);
+    const int ret = av_read_frame(format_context, packet);
+    if (ret == 0) stats_count(STATS_PACKETS, 1);
+    return ret;
+}
+
+// Opens the input and reads the stream info as bounded by options (or the global probe options when null),
+// skipping avformat_find_stream_info when allowed and the header already describes the best stream of type.
+// Everything is released if this fails. Implemented in probe.cpp.
+int open_input(AVFormatContext** format_context, const LagrangeProbeOptions* options, AVMediaType type);
+
+#endif //LAGRANGECODEC_UTIL_H
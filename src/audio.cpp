@@ -2,7 +2,18 @@
 // Created by Wenxuan Lin on 2025-02-23.
 //
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <thread>
+#include <vector>
+
 #include "audio.h"
+#include "buffer_writer.h"
+#include "mapped_file.h"
+#include "ring_buffer.h"
+#include "silk.h"
 #include "util.h"
 
 extern "C" {
@@ -11,63 +22,148 @@ extern "C" {
 #include <libswresample/swresample.h>
 }
 
-int audio_to_pcm(uint8_t* audio_data, int data_len, cb_codec callback, void* userdata) {
-    AVFormatContext* format_context = nullptr;
-    int ret;
-    if (create_format_context(audio_data, data_len, &format_context) < 0) {
-        fprintf(stderr, "ERROR: failed to create format context\n");
-        return -1;
+// Collects the resampler output in a reused buffer and hands it to the callback in chunks
+struct PcmSink {
+    cb_codec* callback;
+    void* userdata;
+    size_t chunk_bytes; // 0 passes every conversion through as it is
+    std::vector<uint8_t> buffer;
+    size_t filled = 0;
+
+    uint8_t* reserve(int samples) {
+        const size_t needed = filled + samples * sizeof(int16_t);
+        if (buffer.size() < needed) buffer.resize(needed);
+        return buffer.data() + filled;
     }
 
-    if (avformat_open_input(&format_context, nullptr, nullptr, nullptr) < 0) {
-        av_free(format_context->pb->buffer);
-        return -1;
+    void commit(int samples) {
+        filled += samples * sizeof(int16_t);
+        if (chunk_bytes == 0) {
+            finish();
+            return;
+        }
+
+        size_t offset = 0;
+        for (; filled - offset >= chunk_bytes; offset += chunk_bytes) {
+            callback(userdata, buffer.data() + offset, static_cast<int>(chunk_bytes));
+        }
+        if (offset > 0) {
+            memmove(buffer.data(), buffer.data() + offset, filled - offset);
+            filled -= offset;
+        }
     }
 
-    ret = avformat_find_stream_info(format_context, nullptr);
-    if (ret < 0) {
-        fprintf(stderr, "ERROR: failed to stream info \n");
+    void finish() {
+        if (filled > 0) callback(userdata, buffer.data(), static_cast<int>(filled));
+        filled = 0;
+    }
+};
+
+// Resamples one decoded frame into the sink, a null frame drains the samples buffered in the resampler
+static int convert_frame(SwrContext* swr_context, PcmSink& sink, const AVFrame* frame) {
+    const int in_samples = frame ? frame->nb_samples : 0;
+    const int max_out = swr_get_out_samples(swr_context, in_samples);
+    if (max_out <= 0) return 0;
+
+    uint8_t* out = sink.reserve(max_out);
+    int n;
+    {
+        StageTimer timer(LAGRANGE_STAGE_RESAMPLE);
+        n = swr_convert(swr_context, &out, max_out,
+                        frame ? const_cast<const uint8_t**>(frame->extended_data) : nullptr, in_samples);
+    }
+    if (n > 0) sink.commit(n);
+    return n;
+}
+
+static int receive_frame(AVCodecContext* decoder_ctx, AVFrame* frame) {
+    StageTimer timer(LAGRANGE_STAGE_DECODE);
+    const int ret = avcodec_receive_frame(decoder_ctx, frame);
+    if (ret == 0) stats_count(STATS_FRAMES, 1);
+    return ret;
+}
+
+static int send_packet(AVCodecContext* decoder_ctx, const AVPacket* packet) {
+    StageTimer timer(LAGRANGE_STAGE_DECODE);
+    return avcodec_send_packet(decoder_ctx, packet);
+}
+
+static void receive_frames(AVCodecContext* decoder_ctx, AVFrame* frame, SwrContext* swr_context, PcmSink& sink) {
+    while (receive_frame(decoder_ctx, frame) == 0) {
+        convert_frame(swr_context, sink, frame);
+        av_frame_unref(frame);
+    }
+}
+
+static size_t chunk_bytes_of(const AudioToPcmOptions* options) {
+    if (!options) return 0;
+
+    const size_t by_ms = options->chunkMs > 0 ? options->chunkMs * (SILKV3_SAMPLE_RATE / 1000) * sizeof(int16_t) : 0;
+    const size_t by_bytes = options->chunkBytes > 0 ? options->chunkBytes & ~static_cast<size_t>(1) : 0; // Whole samples only
+    if (by_ms && by_bytes) return std::min(by_ms, by_bytes);
+    return by_ms ? by_ms : by_bytes;
+}
+
+// Demuxer, decoder and resampler of the best audio stream of an input
+struct AudioDecoder {
+    AVFormatContext* format_context = nullptr;
+    AVCodecContext* decoder_ctx = nullptr;
+    SwrContext* swr_context = nullptr;
+    int stream_index = -1;
+};
+
+static void close_audio_decoder(AudioDecoder& decoder) {
+    swr_free(&decoder.swr_context);
+    avcodec_free_context(&decoder.decoder_ctx);
+    free_format_context(&decoder.format_context);
+}
+
+// Opens the input of a context from create_format_context and sets up decoding to 24 kHz mono,
+// the context is released if this fails and by close_audio_decoder otherwise
+static int open_audio_decoder(AVFormatContext* format_context, const LagrangeProbeOptions* probe, AudioDecoder& decoder) {
+    int ret;
+    if (open_input(&format_context, probe, AVMEDIA_TYPE_AUDIO) < 0) {
         return -1;
     }
+    decoder.format_context = format_context;
 
-    printf("DEBUG: number of streams found: %d\n", format_context->nb_streams);
+    LOG_DEBUG("number of streams found: %u", format_context->nb_streams);
     const int stream_index = av_find_best_stream(format_context, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
     if (stream_index < 0) {
-        fprintf(stderr, "ERROR: no audio stream found\n");
+        LOG_ERROR("no audio stream found");
+        close_audio_decoder(decoder);
         return -1;
     }
+    decoder.stream_index = stream_index;
 
     const AVStream *stream = format_context->streams[stream_index];
 
-    const AVCodec *decoder = avcodec_find_decoder(stream->codecpar->codec_id);
-    if (!decoder) {
-        fprintf(stderr, "ERROR: no decoder found\n");
+    const AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        LOG_ERROR("no decoder found");
+        close_audio_decoder(decoder);
         return -1;
     }
 
-    AVCodecContext *decoder_ctx = avcodec_alloc_context3(decoder);
+    AVCodecContext *decoder_ctx = avcodec_alloc_context3(codec);
+    decoder.decoder_ctx = decoder_ctx;
 
     avcodec_parameters_to_context(decoder_ctx, stream->codecpar);
 
-    ret = avcodec_open2(decoder_ctx, decoder, nullptr);
+    ret = avcodec_open2(decoder_ctx, codec, nullptr);
     if (ret < 0) {
-        fprintf(stderr, "ERROR: failed to open the decoder\n");
+        LOG_ERROR("failed to open the decoder");
+        close_audio_decoder(decoder);
         return -1;
     }
     if (decoder_ctx->channel_layout == 0) {
         decoder_ctx->channel_layout = av_get_default_channel_layout(decoder_ctx->channels);
     }
-    printf(
-        "DEBUG: Setting up decoder - sample format: %s, sample rate: %d Hz, "
-        "channels: %d \n",
-        av_get_sample_fmt_name(static_cast<AVSampleFormat>(stream->codecpar->format)),
-        stream->codecpar->sample_rate, stream->codecpar->channels);
-
-    // Step 2: Decode audio
-    AVPacket *packet = av_packet_alloc();
-    AVFrame *frame = av_frame_alloc();
+    LOG_DEBUG("setting up decoder - sample format: %s, sample rate: %d Hz, channels: %d",
+              av_get_sample_fmt_name(static_cast<AVSampleFormat>(stream->codecpar->format)),
+              stream->codecpar->sample_rate, stream->codecpar->channels);
 
-    SwrContext *swr_context = swr_alloc_set_opts(
+    decoder.swr_context = swr_alloc_set_opts(
         nullptr,
         AV_CH_LAYOUT_MONO,
         AV_SAMPLE_FMT_S16,
@@ -79,32 +175,396 @@ int audio_to_pcm(uint8_t* audio_data, int data_len, cb_codec callback, void* use
         nullptr
     );
 
-    ret = swr_init(swr_context);
+    ret = swr_init(decoder.swr_context);
+    if (ret < 0) {
+        LOG_ERROR("failed to initialize the resampler");
+        close_audio_decoder(decoder);
+        return -1;
+    }
+
+    return 0;
+}
 
-    while (av_read_frame(format_context, packet) == 0) {
-        if (packet->stream_index != stream_index) {
+// Decodes the whole stream into callback, stops early once abort (may be null) is set
+static int run_audio_decoder(AudioDecoder& decoder, size_t chunk_bytes, cb_codec callback, void* userdata,
+                             const std::atomic<bool>* abort = nullptr) {
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    if (!packet || !frame) {
+        LOG_ERROR("failed to allocate packet or frame");
+        av_frame_free(&frame);
+        av_packet_free(&packet);
+        return -1;
+    }
+
+    PcmSink sink = { callback, userdata, chunk_bytes };
+    while (read_packet(decoder.format_context, packet) == 0) {
+        if (abort && abort->load(std::memory_order_relaxed)) {
+            av_packet_unref(packet);
+            break;
+        }
+        if (packet->stream_index != decoder.stream_index) {
             av_packet_unref(packet);
             continue;
         }
-        ret = avcodec_send_packet(decoder_ctx, packet);
-        while ((ret = avcodec_receive_frame(decoder_ctx, frame)) == 0) {
-            AVFrame *out = av_frame_alloc();
-            out->sample_rate = 24000;
-            out->channel_layout = AV_CH_LAYOUT_MONO;
-            out->channels = 1;
-            out->format = AV_SAMPLE_FMT_S16;
-            ret = swr_convert_frame(swr_context, out, frame);
-            callback(userdata, out->data[0], out->nb_samples * out->channels * 2);
-            av_frame_unref(frame);
-            av_frame_free(&out);
+        if (send_packet(decoder.decoder_ctx, packet) == 0) {
+            receive_frames(decoder.decoder_ctx, frame, decoder.swr_context, sink);
         }
         av_packet_unref(packet);
     }
 
-    swr_free(&swr_context);
-    avcodec_close(decoder_ctx);
-    avformat_close_input(&format_context);
+    // Drain the frames delayed in the decoder, then the samples buffered in the resampler
+    if (!abort || !abort->load(std::memory_order_relaxed)) {
+        if (send_packet(decoder.decoder_ctx, nullptr) == 0) {
+            receive_frames(decoder.decoder_ctx, frame, decoder.swr_context, sink);
+        }
+        while (convert_frame(decoder.swr_context, sink, nullptr) > 0) {}
+        sink.finish();
+    }
 
+    av_frame_free(&frame);
+    av_packet_free(&packet);
     return 0;
 }
 
+// Decodes the best audio stream of a context from create_format_context, the context is always released
+static int decode_audio(AVFormatContext* format_context, const AudioToPcmOptions* options,
+                        cb_codec callback, void* userdata) {
+    AudioDecoder decoder;
+    if (open_audio_decoder(format_context, options ? options->probe : nullptr, decoder) < 0) {
+        return -1;
+    }
+
+    const int ret = run_audio_decoder(decoder, chunk_bytes_of(options), callback, userdata);
+    close_audio_decoder(decoder);
+    return ret;
+}
+
+
+int audio_to_pcm(uint8_t* audio_data, int data_len, cb_codec callback, void* userdata) {
+    return audio_to_pcm_ex(audio_data, data_len, nullptr, callback, userdata);
+}
+
+int audio_to_pcm_ex(uint8_t* audio_data, int data_len, const AudioToPcmOptions* options,
+                    cb_codec callback, void* userdata) {
+    CallScope scope("audio_to_pcm");
+    scope.wrap_output(callback, userdata);
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(audio_data, data_len, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return scope.result(-1);
+    }
+
+    return scope.result(decode_audio(format_context, options, callback, userdata));
+}
+
+int audio_to_pcm_io(const LagrangeIoSource* source, cb_codec callback, void* userdata) {
+    CallScope scope("audio_to_pcm");
+    scope.wrap_output(callback, userdata);
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(source, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return scope.result(-1);
+    }
+
+    return scope.result(decode_audio(format_context, nullptr, callback, userdata));
+}
+
+int audio_to_pcm_file(const char* path, const AudioToPcmOptions* options, cb_codec callback, void* userdata) {
+    MappedFile file;
+    if (!map_input(file, path, true)) {
+        return -1;
+    }
+
+    return audio_to_pcm_ex(file.data(), static_cast<int>(file.size()), options, callback, userdata);
+}
+
+int audio_to_pcm_max_output_size(uint8_t* audio_data, int data_len, const LagrangeProbeOptions* probe) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(audio_data, data_len, &format_context) < 0 ||
+        open_input(&format_context, probe, AVMEDIA_TYPE_AUDIO) < 0) {
+        return LAGRANGE_ERROR_FAILED;
+    }
+
+    int64_t duration_us = format_context->duration;
+    const bool from_bitrate = format_context->duration_estimation_method == AVFMT_DURATION_FROM_BITRATE;
+    const int stream_index = av_find_best_stream(format_context, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (duration_us == AV_NOPTS_VALUE && stream_index >= 0) {
+        const AVStream* stream = format_context->streams[stream_index];
+        if (stream->duration != AV_NOPTS_VALUE) {
+            duration_us = av_rescale_q(stream->duration, stream->time_base, { 1, AV_TIME_BASE });
+        }
+    }
+    free_format_context(&format_context);
+    if (stream_index < 0) {
+        return LAGRANGE_ERROR_FAILED;
+    }
+    if (duration_us == AV_NOPTS_VALUE || duration_us <= 0) {
+        // Guessing from the input size and a bitrate would not be an upper bound, so there is none
+        LOG_DEBUG("no duration in the container, the PCM size can't be bounded");
+        return LAGRANGE_ERROR_FAILED;
+    }
+    if (from_bitrate) {
+        // Input size over the first bitrate seen, VBR streams without a seek table end up far off it
+        LOG_DEBUG("duration estimated from the bitrate, the PCM size can't be bounded");
+        return LAGRANGE_ERROR_FAILED;
+    }
+
+    // Leave 5% and a second of room for rounded container durations and the resampler
+    const int64_t samples = av_rescale(duration_us + duration_us / 20 + AV_TIME_BASE, SILKV3_SAMPLE_RATE, AV_TIME_BASE);
+    const int64_t size = samples * static_cast<int64_t>(sizeof(int16_t));
+    return size > INT_MAX ? LAGRANGE_ERROR_FAILED : static_cast<int>(size);
+}
+
+int audio_to_pcm_into(uint8_t* audio_data, int data_len, const AudioToPcmOptions* options,
+                      uint8_t* out, int out_capacity) {
+    if (!out || out_capacity < 0) {
+        return LAGRANGE_ERROR_FAILED;
+    }
+
+    BufferWriter writer = { out, out_capacity, 0, false };
+    return buffer_writer_result(writer, audio_to_pcm_ex(audio_data, data_len, options, buffer_writer_write, &writer));
+}
+
+struct SilkSink {
+    SilkEncoder* encoder;
+    int result;
+    std::atomic<bool> failed { false }; // Tells the decoder to stop once the encoder gave up
+};
+
+static void push_to_encoder(void* userdata, const uint8_t* p, int len) {
+    auto* sink = static_cast<SilkSink*>(userdata);
+    if (sink->result == 0) {
+        sink->result = silk_encoder_push(sink->encoder, p, len);
+        if (sink->result != 0) sink->failed = true;
+    }
+}
+
+struct RingSink {
+    RingBuffer* ring;
+    std::atomic<bool>* failed;
+};
+
+static void push_to_ring(void* userdata, const uint8_t* p, int len) {
+    auto* sink = static_cast<RingSink*>(userdata);
+    if (!sink->ring->write(p, len)) {
+        *sink->failed = true; // Closed by the consumer
+    }
+}
+
+// Holds back runs of silent 20 ms frames, so leading and trailing silence of at least min_frames never
+// reaches the encoder. Silence between speech is passed on and left to DTX, and so is trailing silence
+// beyond the last MAX_HELD_BYTES of it.
+struct SilenceTrimmer {
+    static constexpr int FRAME_BYTES = 20 * (SILKV3_SAMPLE_RATE / 1000) * sizeof(int16_t);
+    // Silence after speech held back at most, anything older goes on to DTX and is never trimmed
+    static constexpr size_t MAX_HELD_BYTES = 2000 * (SILKV3_SAMPLE_RATE / 1000) * sizeof(int16_t);
+
+    cb_codec* next;
+    void* next_userdata;
+    double energy_limit; // Mean square sample value below which a frame is silent
+    size_t min_bytes;
+    bool voiced = false; // Speech was passed on already, so held back silence is not leading
+    std::vector<uint8_t> pending; // Silent frames waiting for the next voiced frame or the end, min_bytes at most while leading
+    size_t silent_run = 0; // Bytes of the current silent run, including what no longer is in pending
+    uint8_t frame[FRAME_BYTES];
+    int buffered = 0;
+    int64_t trimmed_bytes = 0;
+
+    size_t max_held_bytes() const { return std::max(min_bytes, MAX_HELD_BYTES); }
+};
+
+static bool frame_is_silent(const SilenceTrimmer& trimmer, const uint8_t* frame, int len) {
+    int16_t samples[SilenceTrimmer::FRAME_BYTES / sizeof(int16_t)];
+    const int count = len / static_cast<int>(sizeof(int16_t));
+    memcpy(samples, frame, count * sizeof(int16_t));
+
+    double energy = 0;
+    for (int i = 0; i < count; i++) {
+        energy += static_cast<double>(samples[i]) * samples[i];
+    }
+    return count == 0 || energy / count < trimmer.energy_limit;
+}
+
+static void trimmer_emit_frame(SilenceTrimmer& trimmer, const uint8_t* frame, int len) {
+    if (frame_is_silent(trimmer, frame, len)) {
+        trimmer.pending.insert(trimmer.pending.end(), frame, frame + len);
+        trimmer.silent_run += len;
+        if (!trimmer.voiced && trimmer.pending.size() > trimmer.min_bytes) {
+            // Leading silence this long is dropped anyway, keep just enough to still recognise it
+            const size_t excess = trimmer.pending.size() - trimmer.min_bytes;
+            trimmer.trimmed_bytes += static_cast<int64_t>(excess);
+            trimmer.pending.erase(trimmer.pending.begin(), trimmer.pending.begin() + static_cast<std::ptrdiff_t>(excess));
+        } else if (trimmer.voiced && trimmer.pending.size() > trimmer.max_held_bytes()) {
+            // A long pause after speech, only its tail can still turn out to be trailing silence
+            const size_t excess = trimmer.pending.size() - trimmer.max_held_bytes();
+            trimmer.next(trimmer.next_userdata, trimmer.pending.data(), static_cast<int>(excess));
+            trimmer.pending.erase(trimmer.pending.begin(), trimmer.pending.begin() + static_cast<std::ptrdiff_t>(excess));
+        }
+        return;
+    }
+
+    if (!trimmer.pending.empty()) {
+        if (!trimmer.voiced && trimmer.pending.size() >= trimmer.min_bytes) {
+            trimmer.trimmed_bytes += static_cast<int64_t>(trimmer.pending.size()); // Leading silence
+        } else {
+            trimmer.next(trimmer.next_userdata, trimmer.pending.data(), static_cast<int>(trimmer.pending.size()));
+        }
+        trimmer.pending.clear();
+    }
+    trimmer.silent_run = 0;
+    trimmer.voiced = true;
+    trimmer.next(trimmer.next_userdata, frame, len);
+}
+
+static void trimmer_push(void* userdata, const uint8_t* p, int len) {
+    auto& trimmer = *static_cast<SilenceTrimmer*>(userdata);
+    while (len > 0) {
+        const int n = std::min(len, SilenceTrimmer::FRAME_BYTES - trimmer.buffered);
+        memcpy(trimmer.frame + trimmer.buffered, p, n);
+        trimmer.buffered += n;
+        p += n;
+        len -= n;
+
+        if (trimmer.buffered == SilenceTrimmer::FRAME_BYTES) {
+            trimmer.buffered = 0;
+            trimmer_emit_frame(trimmer, trimmer.frame, SilenceTrimmer::FRAME_BYTES);
+        }
+    }
+}
+
+// Classifies the partial last frame, then drops the trailing silence if it is long enough
+static void trimmer_finish(SilenceTrimmer& trimmer) {
+    if (trimmer.buffered > 0) {
+        trimmer_emit_frame(trimmer, trimmer.frame, trimmer.buffered);
+        trimmer.buffered = 0;
+    }
+
+    if (!trimmer.pending.empty()) {
+        if (trimmer.silent_run >= trimmer.min_bytes || !trimmer.voiced) {
+            trimmer.trimmed_bytes += static_cast<int64_t>(trimmer.pending.size());
+        } else {
+            trimmer.next(trimmer.next_userdata, trimmer.pending.data(), static_cast<int>(trimmer.pending.size()));
+        }
+        trimmer.pending.clear();
+    }
+}
+
+// Feeds the resampler output of a context from create_format_context straight into a SILK encoder
+static int transcode_to_silk(AVFormatContext* format_context, const AudioToSilkOptions* options,
+                             cb_codec callback, void* userdata) {
+    const bool trim = options && options->trimSilence;
+    SilkEncoderOptions encoder_options = { };
+    if (options && options->encoder) {
+        encoder_options = *options->encoder;
+    } else {
+        silk_encoder_options_preset("default", &encoder_options);
+    }
+    encoder_options.sampleRate = SILKV3_SAMPLE_RATE; // What the resampler produces
+    encoder_options.channels = 1;
+    if (trim) {
+        encoder_options.useDTX = 1;
+    }
+
+    // Open the input first, creating the encoder already writes the header to the callback
+    AudioDecoder decoder;
+    if (open_audio_decoder(format_context, nullptr, decoder) < 0) {
+        return -1;
+    }
+
+    SilkEncoder* encoder = silk_encoder_create_ex(&encoder_options, callback, userdata);
+    if (!encoder) {
+        close_audio_decoder(decoder);
+        return 1;
+    }
+
+    SilkSink sink = { encoder, 0 };
+    SilenceTrimmer trimmer = { push_to_encoder, &sink };
+    if (trim) {
+        // Sample amplitude of the dBFS threshold, squared to compare against the mean square
+        const int threshold_db = options->silenceThresholdDb < 0 ? options->silenceThresholdDb : AUDIO_TO_SILK_SILENCE_DB;
+        const double amplitude = 32768.0 * std::pow(10.0, threshold_db / 20.0);
+        trimmer.energy_limit = amplitude * amplitude;
+        const int min_ms = options->minSilenceMs > 0 ? options->minSilenceMs : AUDIO_TO_SILK_MIN_SILENCE_MS;
+        trimmer.min_bytes = static_cast<size_t>(min_ms) * (SILKV3_SAMPLE_RATE / 1000) * sizeof(int16_t);
+    }
+    cb_codec* push = trim ? trimmer_push : push_to_encoder;
+    void* push_userdata = trim ? static_cast<void*>(&trimmer) : &sink;
+
+    int ret;
+    if (!options || !options->pipelined) {
+        ret = run_audio_decoder(decoder, 0, push, push_userdata, &sink.failed);
+    } else {
+        // Demux and decode on a worker thread, encode on the calling thread so the callback stays there
+        RingBuffer ring(options->ringBufferBytes > 0 ? options->ringBufferBytes : AUDIO_TO_SILK_RING_BYTES);
+        RingSink ring_sink = { &ring, &sink.failed };
+        std::thread producer([&, context = call_context()] {
+            CallAdopt adopt(context);
+            ret = run_audio_decoder(decoder, 0, push_to_ring, &ring_sink, &sink.failed);
+            ring.close();
+        });
+
+        uint8_t chunk[4096];
+        size_t n;
+        while ((n = ring.read(chunk, sizeof(chunk))) > 0) {
+            push(push_userdata, chunk, static_cast<int>(n));
+            if (sink.result != 0) {
+                ring.close(); // Unblocks the producer, which stops at its next packet
+                break;
+            }
+        }
+        producer.join();
+    }
+    close_audio_decoder(decoder);
+
+    if (ret == 0 && trim) {
+        trimmer_finish(trimmer);
+    }
+    if (ret == 0) {
+        ret = sink.result;
+    }
+    if (ret == 0) {
+        ret = silk_encoder_flush(encoder);
+    }
+    if (trim && options->trimmedMs) {
+        *options->trimmedMs = trimmer.trimmed_bytes / static_cast<int64_t>((SILKV3_SAMPLE_RATE / 1000) * sizeof(int16_t));
+    }
+
+    silk_encoder_destroy(encoder);
+    return ret;
+}
+
+int audio_to_silk(uint8_t* audio_data, int data_len, const AudioToSilkOptions* options,
+                  cb_codec callback, void* userdata) {
+    CallScope scope("audio_to_silk");
+    scope.wrap_output(callback, userdata);
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(audio_data, data_len, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return scope.result(-1);
+    }
+
+    return scope.result(transcode_to_silk(format_context, options, callback, userdata));
+}
+
+int audio_to_silk_io(const LagrangeIoSource* source, const AudioToSilkOptions* options,
+                     cb_codec callback, void* userdata) {
+    CallScope scope("audio_to_silk");
+    scope.wrap_output(callback, userdata);
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(source, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return scope.result(-1);
+    }
+
+    return scope.result(transcode_to_silk(format_context, options, callback, userdata));
+}
+
+int audio_to_silk_file(const char* path, const AudioToSilkOptions* options, cb_codec callback, void* userdata) {
+    MappedFile file;
+    if (!map_input(file, path, true)) {
+        return -1;
+    }
+
+    return audio_to_silk(file.data(), static_cast<int>(file.size()), options, callback, userdata);
+}
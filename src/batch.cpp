@@ -0,0 +1,178 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "audio.h"
+#include "batch.h"
+#include "instrument.h"
+#include "silk.h"
+#include "thread_pool.h"
+#include "video.h"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+namespace {
+    std::atomic<int> max_queued_jobs { LAGRANGE_DEFAULT_MAX_QUEUED_JOBS };
+    std::atomic<int> jobs_in_flight { 0 };
+
+    int video_first_frame_job(LagrangeJob* job) {
+        uint8_t* image = nullptr;
+        int image_len = 0;
+        const int ret = video_first_frame(job->data, job->dataLen, image, image_len);
+        if (ret == 0) {
+            job->callback(job->userdata, image, image_len);
+        }
+        av_free(image);
+        return ret;
+    }
+
+    // Deadline of a job started now, 0 for none
+    int64_t job_deadline(const LagrangeJob* job) {
+        return job->timeoutMs > 0 ? stats_now_ns() + job->timeoutMs * 1000000 : 0;
+    }
+
+    int run_job(LagrangeJob* job) {
+        switch (job->type) {
+            case LAGRANGE_JOB_SILK_ENCODE:
+                return silk_encode(job->data, job->dataLen, job->callback, job->userdata);
+            case LAGRANGE_JOB_SILK_DECODE:
+                return silk_decode(job->data, job->dataLen, job->callback, job->userdata);
+            case LAGRANGE_JOB_AUDIO_TO_PCM:
+                return audio_to_pcm(job->data, job->dataLen, job->callback, job->userdata);
+            case LAGRANGE_JOB_AUDIO_TO_SILK:
+                return audio_to_silk(job->data, job->dataLen, nullptr, job->callback, job->userdata);
+            case LAGRANGE_JOB_VIDEO_FIRST_FRAME:
+                return video_first_frame_job(job);
+            default:
+                return 1;
+        }
+    }
+
+    // Runs the job under its own limits, a job that expired or was cancelled while queued is not started
+    int run_job_limited(LagrangeJob* job, int64_t deadline_ns) {
+        if (!job->callback) {
+            return job->status = 1;
+        }
+        if (!deadline_ns && !job->cancel) {
+            return job->status = run_job(job);
+        }
+
+        CallLimits limits;
+        limits.deadline_ns = deadline_ns;
+        limits.cancel = job->cancel;
+        if (const int stopped = call_limits_check(limits)) {
+            return job->status = stopped;
+        }
+
+        const ThreadLimits previous = set_thread_limits({ 0, deadline_ns, job->cancel });
+        job->status = run_job(job);
+        set_thread_limits(previous);
+        return job->status;
+    }
+
+    struct Batch {
+        LagrangeJob* jobs;
+        int count;
+        std::vector<int64_t> deadlines; // Taken when the batch starts
+        std::atomic<int> next { 0 };
+        std::mutex mutex;
+        std::condition_variable done;
+        int finished = 0;
+        int failed = 0;
+    };
+
+    // Runs jobs of the batch until none is left to take
+    void run_batch(Batch& batch) {
+        int index;
+        while ((index = batch.next++) < batch.count) {
+            const int status = run_job_limited(&batch.jobs[index], batch.deadlines[index]);
+
+            std::lock_guard lock(batch.mutex);
+            if (status != 0) batch.failed++;
+            if (++batch.finished == batch.count) {
+                batch.done.notify_all();
+            }
+        }
+    }
+}
+
+int lagrange_pool_configure(const LagrangePoolOptions* options) {
+    if (!options || options->threadCount < 0 || options->maxQueuedJobs < 0) {
+        return 1;
+    }
+
+    max_queued_jobs = options->maxQueuedJobs > 0 ? options->maxQueuedJobs : LAGRANGE_DEFAULT_MAX_QUEUED_JOBS;
+    ThreadPool::configure_shared(options->threadCount, options->pinThreads != 0);
+    return 0;
+}
+
+int lagrange_job_run(LagrangeJob* job) {
+    if (!job) {
+        return 1;
+    }
+
+    return run_job_limited(job, job_deadline(job));
+}
+
+int lagrange_batch_run(LagrangeJob* jobs, int count) {
+    if (!jobs || count < 0) {
+        return -1;
+    }
+
+    // Shared with the pool tasks, a task that starts after the batch is done finds nothing left to take
+    auto batch = std::make_shared<Batch>();
+    batch->jobs = jobs;
+    batch->count = count;
+    batch->deadlines.resize(count);
+    for (int i = 0; i < count; i++) {
+        batch->deadlines[i] = job_deadline(&jobs[i]);
+    }
+
+    // The calling thread takes jobs too, so a batch started from a busy pool worker still completes
+    const auto pool = ThreadPool::shared();
+    const int helpers = std::min(count - 1, pool->size());
+    for (int i = 0; i < helpers; i++) {
+        pool->submit([batch] { run_batch(*batch); });
+    }
+    run_batch(*batch);
+
+    std::unique_lock lock(batch->mutex);
+    batch->done.wait(lock, [&] { return batch->finished == count; });
+    return batch->failed;
+}
+
+int lagrange_submit(LagrangeJob* job, cb_job_complete* on_complete) {
+    if (!job) {
+        return LAGRANGE_ERROR_FAILED;
+    }
+
+    // Take a slot before queueing, so concurrent submitters can't overshoot the limit
+    int in_flight = jobs_in_flight.load();
+    do {
+        if (in_flight >= max_queued_jobs.load()) {
+            return LAGRANGE_ERROR_BUSY;
+        }
+    } while (!jobs_in_flight.compare_exchange_weak(in_flight, in_flight + 1));
+
+    ThreadPool::shared()->submit([job, on_complete, deadline = job_deadline(job)] {
+        run_job_limited(job, deadline);
+        jobs_in_flight--; // Released first, so the completion can submit the next job right away
+        if (on_complete) {
+            on_complete(job);
+        }
+    });
+    return 0;
+}
+
+int lagrange_jobs_in_flight() {
+    return jobs_in_flight.load();
+}
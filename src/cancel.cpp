@@ -0,0 +1,81 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "instrument.h"
+
+struct LagrangeCancelToken {
+    std::atomic<bool> cancelled { false };
+};
+
+namespace {
+    thread_local ThreadLimits thread_limits {};
+}
+
+thread_local CallLimits* active_limits = nullptr;
+
+ThreadLimits set_thread_limits(const ThreadLimits& limits) {
+    const ThreadLimits previous = thread_limits;
+    thread_limits = limits;
+    return previous;
+}
+
+bool call_limits_arm(CallLimits& limits) {
+    const ThreadLimits& current = thread_limits;
+    if (!current.timeout_ns && !current.deadline_ns && !current.cancel) return false;
+
+    int64_t deadline = current.deadline_ns;
+    if (current.timeout_ns) {
+        const int64_t timeout_deadline = stats_now_ns() + current.timeout_ns;
+        deadline = deadline ? std::min(deadline, timeout_deadline) : timeout_deadline;
+    }
+    limits.deadline_ns = deadline;
+    limits.cancel = current.cancel;
+    return true;
+}
+
+int call_limits_check(CallLimits& limits) {
+    const int stopped = limits.stopped.load(std::memory_order_relaxed);
+    if (stopped) return stopped;
+
+    int code = 0;
+    if (limits.cancel && limits.cancel->cancelled.load(std::memory_order_relaxed)) {
+        code = LAGRANGE_ERROR_CANCELLED;
+    } else if (limits.deadline_ns && stats_now_ns() >= limits.deadline_ns) {
+        code = LAGRANGE_ERROR_TIMEOUT;
+    }
+    if (!code) return 0;
+
+    // The first thread to notice wins, so every worker of the call reports the same reason
+    int expected = 0;
+    limits.stopped.compare_exchange_strong(expected, code, std::memory_order_relaxed);
+    return expected ? expected : code;
+}
+
+LagrangeCancelToken* lagrange_cancel_token_create(void) {
+    return new (std::nothrow) LagrangeCancelToken;
+}
+
+void lagrange_cancel_token_cancel(LagrangeCancelToken* token) {
+    if (token) token->cancelled.store(true, std::memory_order_relaxed);
+}
+
+int lagrange_cancel_token_is_cancelled(const LagrangeCancelToken* token) {
+    return token && token->cancelled.load(std::memory_order_relaxed) ? 1 : 0;
+}
+
+void lagrange_cancel_token_destroy(LagrangeCancelToken* token) {
+    delete token;
+}
+
+void lagrange_set_call_limits(const LagrangeCallLimits* limits) {
+    if (!limits) {
+        set_thread_limits({});
+        return;
+    }
+    set_thread_limits({ std::max<int64_t>(limits->timeoutMs, 0) * 1000000, 0, limits->cancel });
+}
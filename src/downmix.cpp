@@ -0,0 +1,56 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include "downmix.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LAGRANGE_DOWNMIX_SSE2
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(_M_ARM64)) && !defined(__ARM_BIG_ENDIAN)
+#define LAGRANGE_DOWNMIX_NEON
+#include <arm_neon.h>
+#endif
+
+// Byte wise, so it is correct on big endian hosts too
+static void downmix_stereo_scalar(const uint8_t* in, uint8_t* out, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        const auto left = static_cast<int16_t>(in[0] | in[1] << 8);
+        const auto right = static_cast<int16_t>(in[2] | in[3] << 8);
+        const int mono = (left + right) >> 1;
+        out[0] = static_cast<uint8_t>(mono & 0xFF);
+        out[1] = static_cast<uint8_t>((mono >> 8) & 0xFF);
+        in += 4;
+        out += 2;
+    }
+}
+
+void downmix_stereo(const uint8_t* in, uint8_t* out, size_t samples) {
+    size_t done = 0;
+
+#if defined(LAGRANGE_DOWNMIX_SSE2)
+    // madd against ones sums every L/R pair into 32 bits, the shift and pack bring it back to 16
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; done + 8 <= samples; done += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done * 4));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done * 4 + 16));
+        const __m128i sum_a = _mm_srai_epi32(_mm_madd_epi16(a, ones), 1);
+        const __m128i sum_b = _mm_srai_epi32(_mm_madd_epi16(b, ones), 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done * 2), _mm_packs_epi32(sum_a, sum_b));
+    }
+#elif defined(LAGRANGE_DOWNMIX_NEON)
+    // vld2 splits the channels, the halving add is (L + R) >> 1 without overflow
+    for (; done + 8 <= samples; done += 8) {
+        int16_t buffer[16];
+        memcpy(buffer, in + done * 4, sizeof(buffer));
+        const int16x8x2_t channels = vld2q_s16(buffer);
+        const int16x8_t mono = vhaddq_s16(channels.val[0], channels.val[1]);
+        vst1q_s16(buffer, mono);
+        memcpy(out + done * 2, buffer, 8 * sizeof(int16_t));
+    }
+#endif
+
+    downmix_stereo_scalar(in + done * 4, out + done * 2, samples - done);
+}
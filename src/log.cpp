@@ -0,0 +1,100 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "logger.h"
+
+extern "C" {
+#include <libavutil/log.h>
+}
+
+std::atomic<int> lagrange_log_level { LAGRANGE_LOG_ERROR };
+
+namespace {
+    constexpr int LOG_LINE_SIZE = 1024;
+
+    const char* level_name(int level) {
+        switch (level) {
+            case LAGRANGE_LOG_ERROR: return "ERROR";
+            case LAGRANGE_LOG_WARNING: return "WARNING";
+            case LAGRANGE_LOG_INFO: return "INFO";
+            default: return "DEBUG";
+        }
+    }
+
+    void stderr_sink(void*, int level, const char* message) {
+        fprintf(stderr, "%s: %s\n", level_name(level), message);
+    }
+
+    // Only taken once a message passed the level check, and released before the sink runs, so a sink may
+    // log through the library or swap itself
+    std::mutex sink_mutex;
+    cb_log* sink = stderr_sink;
+    void* sink_userdata = nullptr;
+
+    void emit(int level, char* line) {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0) return;
+
+        cb_log* callback;
+        void* userdata;
+        {
+            std::lock_guard lock(sink_mutex);
+            callback = sink;
+            userdata = sink_userdata;
+        }
+        callback(userdata, level, line);
+    }
+
+    int level_of_av(int av_level) {
+        if (av_level <= AV_LOG_ERROR) return LAGRANGE_LOG_ERROR;
+        if (av_level <= AV_LOG_WARNING) return LAGRANGE_LOG_WARNING;
+        if (av_level <= AV_LOG_INFO) return LAGRANGE_LOG_INFO;
+        return LAGRANGE_LOG_DEBUG;
+    }
+
+    void av_log_sink(void* avcl, int av_level, const char* format, va_list args) {
+        if (av_level <= AV_LOG_QUIET) return;
+        const int level = level_of_av(av_level);
+        if (level > LAGRANGE_LOG_MAX_LEVEL || level > lagrange_log_level.load(std::memory_order_relaxed)) return;
+
+        // FFmpeg may split a line over several calls, the context prefix only goes in front of the first
+        thread_local int print_prefix = 1;
+        char line[LOG_LINE_SIZE];
+        va_list copy;
+        va_copy(copy, args);
+        av_log_format_line2(avcl, av_level, format, copy, line, sizeof(line), &print_prefix);
+        va_end(copy);
+        emit(level, line);
+    }
+
+    // FFmpeg's log callback is process wide, it is only taken over once the host asks for a log callback
+    std::once_flag av_log_installed;
+}
+
+void log_message(int level, const char* format, ...) {
+    char line[LOG_LINE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    emit(level, line);
+}
+
+void lagrange_set_log_callback(int level, cb_log* callback, void* userdata) {
+    {
+        std::lock_guard lock(sink_mutex);
+        sink = callback ? callback : stderr_sink;
+        sink_userdata = callback ? userdata : nullptr;
+    }
+    lagrange_log_level.store(level, std::memory_order_relaxed);
+    std::call_once(av_log_installed, [] { av_log_set_callback(av_log_sink); });
+}
@@ -0,0 +1,110 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path, bool sequential) {
+    close();
+
+    // UTF-8 paths, the same as everywhere else in the API
+    const int wide_len = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+    if (wide_len <= 0) return false;
+    auto* wide_path = new wchar_t[wide_len];
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, wide_path, wide_len);
+
+    const DWORD flags = sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+    HANDLE handle = CreateFileW(wide_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    delete[] wide_path;
+    if (handle == INVALID_HANDLE_VALUE) {
+        LOG_ERROR("failed to open %s", path);
+        return false;
+    }
+    file = handle;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(handle, &file_size)) {
+        close();
+        return false;
+    }
+    length = file_size.QuadPart;
+    if (length == 0) return true; // Can't map an empty file
+
+    mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+        view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (!view) {
+        LOG_ERROR("failed to map %s", path);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (view) UnmapViewOfFile(view);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+    view = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    length = 0;
+}
+
+#else
+
+bool MappedFile::open(const char* path, bool sequential) {
+    close();
+
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("failed to open %s", path);
+        return false;
+    }
+
+    struct stat st {};
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        return false;
+    }
+    length = st.st_size;
+    if (length == 0) { // Can't map an empty file
+        ::close(fd);
+        return true;
+    }
+
+    void* mapped = mmap(nullptr, static_cast<size_t>(length), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps its own reference
+    if (mapped == MAP_FAILED) {
+        LOG_ERROR("failed to map %s", path);
+        length = 0;
+        return false;
+    }
+
+    if (sequential) {
+        madvise(mapped, static_cast<size_t>(length), MADV_SEQUENTIAL);
+    }
+    view = static_cast<uint8_t*>(mapped);
+    return true;
+}
+
+void MappedFile::close() {
+    if (view) munmap(view, static_cast<size_t>(length));
+    view = nullptr;
+    length = 0;
+}
+
+#endif
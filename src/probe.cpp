@@ -0,0 +1,78 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include <mutex>
+#include <string>
+
+#include "probe.h"
+#include "util.h"
+
+namespace {
+    std::mutex global_mutex;
+    LagrangeProbeOptions global_options = { };
+    std::string global_hint;
+
+    // True when the header alone gave the codec parameters of the stream we are after
+    bool header_is_complete(const AVFormatContext* format_context, AVMediaType type) {
+        const int index = av_find_best_stream(const_cast<AVFormatContext*>(format_context), type, -1, -1, nullptr, 0);
+        if (index < 0) return false;
+
+        const AVStream* stream = format_context->streams[index];
+        const AVCodecParameters* codecpar = stream->codecpar;
+        if (codecpar->codec_id == AV_CODEC_ID_NONE) return false;
+        if (format_context->duration == AV_NOPTS_VALUE && stream->duration == AV_NOPTS_VALUE) return false;
+
+        if (type == AVMEDIA_TYPE_VIDEO) {
+            return codecpar->width > 0 && codecpar->height > 0;
+        }
+        // The resampler is set up from the sample format, and only the stream info fills it in for some demuxers
+        return codecpar->sample_rate > 0 && codecpar->channels > 0 && codecpar->format != AV_SAMPLE_FMT_NONE;
+    }
+}
+
+void lagrange_set_probe_options(const LagrangeProbeOptions* options) {
+    std::lock_guard lock(global_mutex);
+    global_options = options ? *options : LagrangeProbeOptions { };
+    global_hint = global_options.formatHint ? global_options.formatHint : "";
+    global_options.formatHint = nullptr;
+}
+
+int open_input(AVFormatContext** format_context, const LagrangeProbeOptions* options, AVMediaType type) {
+    StageTimer timer(LAGRANGE_STAGE_PROBE);
+    LagrangeProbeOptions settings;
+    std::string hint;
+    if (options) {
+        settings = *options;
+        hint = options->formatHint ? options->formatHint : "";
+    } else {
+        std::lock_guard lock(global_mutex);
+        settings = global_options;
+        hint = global_hint;
+    }
+
+    if (settings.probeSize >= 32) {
+        (*format_context)->probesize = settings.probeSize;
+        (*format_context)->format_probesize = static_cast<int>(FFMIN(settings.probeSize, INT32_MAX));
+    }
+    if (settings.analyzeDurationUs > 0) {
+        (*format_context)->max_analyze_duration = settings.analyzeDurationUs;
+    }
+
+    const AVInputFormat* input_format = hint.empty() ? nullptr : av_find_input_format(hint.c_str());
+    if (open_format_context(format_context, input_format) < 0) { // An unknown hint falls back to detection
+        LOG_ERROR("failed to open the media stream");
+        return -1;
+    }
+
+    if (settings.skipStreamInfo && header_is_complete(*format_context, type)) {
+        return 0;
+    }
+
+    if (avformat_find_stream_info(*format_context, nullptr) < 0) {
+        LOG_ERROR("failed to find stream info");
+        free_format_context(format_context);
+        return -1;
+    }
+    return 0;
+}
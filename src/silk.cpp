@@ -2,9 +2,21 @@
 // Created by Wenxuan Lin on 2025-02-23.
 //
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string_view>
+#include <vector>
 
+#include "buffer_writer.h"
+#include "downmix.h"
+#include "instrument.h"
+#include "mapped_file.h"
 #include "silk.h"
+#include "thread_pool.h"
 
 #include <SKP_Silk_SigProc_FIX.h>
 
@@ -14,94 +26,152 @@
 
 constexpr std::string_view silk_magic = "\x02#!SILK_V3";
 constexpr SKP_int32 sample_rate = 24000;
+constexpr int default_pool_capacity = 64;
+constexpr int PARALLEL_MIN_SEGMENT_MS = 10000; // Shorter inputs aren't worth the warm-up and thread hops
+constexpr int PARALLEL_WARMUP_MS = 200; // Encoded before each segment so the predictors have converged
+constexpr int RANGE_PREROLL_PACKETS = 3; // Decoded and dropped ahead of silk_decode_range
 
-int silk_decode(uint8_t* silk_data, int data_len, cb_codec callback, void* userdata) {
-    SKP_uint8 payload[MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES * (MAX_LBRR_DELAY + 1)];
-    SKP_uint8* payloadEnd = nullptr, * payloadToDec = nullptr;
-    SKP_int16 nBytesPerPacket[MAX_LBRR_DELAY + 1];
-    SKP_int32 remainPackets = 0;
-    SKP_int16 len, totalLen = 0, nBytes = 0;
-    SKP_int32 decSizeBytes;
-    uint8_t* psRead = silk_data;
-    void* psDec = nullptr;
+// Idle SKP encoder / decoder states, handed out again after a reset instead of being reallocated
+struct SilkStatePool {
+    int capacity; // Idle states kept per kind, the rest is freed on release
+    std::mutex mutex;
+    std::vector<void*> encoders;
+    std::vector<void*> decoders;
+    std::atomic<int64_t> encoder_hits { 0 };
+    std::atomic<int64_t> encoder_misses { 0 };
+    std::atomic<int64_t> decoder_hits { 0 };
+    std::atomic<int64_t> decoder_misses { 0 };
 
-    SKP_SILK_SDK_DecControlStruct dec_control;
+    explicit SilkStatePool(int capacity) : capacity(capacity) {}
 
-    if (memcmp(psRead, silk_magic.data(), std::size(silk_magic)) != 0) {
-        return 1;
+    ~SilkStatePool() {
+        for (void* state : encoders) free(state);
+        for (void* state : decoders) free(state);
     }
+};
 
-    psRead += std::size(silk_magic);
+static SilkStatePool global_pool(default_pool_capacity);
+static std::atomic<bool> global_pooling { false };
 
-    /* Create decoder */
-    SKP_int32 result = SKP_Silk_SDK_Get_Decoder_Size(&decSizeBytes);
-    if (result) {
-        return 1;
+static SilkStatePool* default_pool() {
+    return global_pooling.load(std::memory_order_relaxed) ? &global_pool : nullptr;
+}
+
+// Returns uninitialised state memory, the caller runs the SKP Init function on it either way
+static void* pool_acquire(SilkStatePool* pool, bool encoder) {
+    if (pool) {
+        std::lock_guard lock(pool->mutex);
+        auto& idle = encoder ? pool->encoders : pool->decoders;
+        if (!idle.empty()) {
+            void* state = idle.back();
+            idle.pop_back();
+            (encoder ? pool->encoder_hits : pool->decoder_hits)++;
+            return state;
+        }
+        (encoder ? pool->encoder_misses : pool->decoder_misses)++;
     }
 
-    psDec = malloc(decSizeBytes);
-    result = SKP_Silk_SDK_InitDecoder(psDec);
-    if (result) {
-        free(psDec);
-        return 1;
+    SKP_int32 size_bytes;
+    if (encoder ? SKP_Silk_SDK_Get_Encoder_Size(&size_bytes) : SKP_Silk_SDK_Get_Decoder_Size(&size_bytes)) {
+        return nullptr;
     }
+    return malloc(size_bytes);
+}
 
-    payloadEnd = payload;
-    dec_control.framesPerPacket = 1;
-    dec_control.API_sampleRate = sample_rate;
+static void pool_release(SilkStatePool* pool, bool encoder, void* state) {
+    if (pool && state) {
+        std::lock_guard lock(pool->mutex);
+        auto& idle = encoder ? pool->encoders : pool->decoders;
+        if (static_cast<int>(idle.size()) < pool->capacity) {
+            idle.push_back(state);
+            return;
+        }
+    }
+    free(state);
+}
 
-    for (int i = 0; i < MAX_LBRR_DELAY; i++) {
-        nBytes = *reinterpret_cast<short*>(psRead); // read size of payload
-        psRead += sizeof(SKP_int16);
+SilkStatePool* silk_pool_create(int capacity) {
+    return new SilkStatePool(capacity > 0 ? capacity : default_pool_capacity);
+}
 
-#ifdef _SYSTEM_IS_BIG_ENDIAN
-        swap_endian(&nBytes, 1);
-#endif
+void silk_pool_destroy(SilkStatePool* pool) {
+    delete pool;
+}
 
-        memcpy(payloadEnd, psRead, nBytes); // read payload
-        psRead += sizeof(SKP_uint8) * nBytes;
+void silk_pool_set_global(int enabled) {
+    global_pooling = enabled != 0;
+}
 
-        nBytesPerPacket[i] = nBytes;
-        payloadEnd += nBytes;
+void silk_pool_get_stats(SilkStatePool* pool, SilkPoolStats* stats) {
+    if (!stats) {
+        return;
+    }
+    if (!pool) {
+        pool = &global_pool;
     }
 
-    nBytesPerPacket[MAX_LBRR_DELAY] = 0;
+    std::lock_guard lock(pool->mutex);
+    stats->encoderHits = pool->encoder_hits;
+    stats->encoderMisses = pool->encoder_misses;
+    stats->decoderHits = pool->decoder_hits;
+    stats->decoderMisses = pool->decoder_misses;
+    stats->idleEncoders = static_cast<int>(pool->encoders.size());
+    stats->idleDecoders = static_cast<int>(pool->decoders.size());
+}
 
-    while (true) {
-        SKP_int16 out[(FRAME_LENGTH_MS * MAX_API_FS_KHZ << 1) * MAX_INPUT_FRAMES];
-        if (remainPackets == 0) {
-            nBytes = *reinterpret_cast<short *>(psRead); // Read payload size
-            psRead += sizeof(SKP_int16);
+struct SilkDecoder {
+    void* state;
+    SilkStatePool* pool;
+    SKP_SILK_SDK_DecControlStruct control;
+    cb_codec* callback;
+    void* userdata;
+    SKP_int32 header_read; // Bytes of silk_magic matched so far
+    SKP_int32 size_read; // Bytes of the current length prefix received so far
+    SKP_uint8 size_bytes[sizeof(SKP_int16)];
+    SKP_int32 packet_size; // Size of the packet being received, -1 while reading its length prefix
+    SKP_int32 packet_read;
+    SKP_int32 queued; // Complete packets waiting in the LBRR delay queue
+    bool ended; // A negative length prefix terminates the stream
+    bool failed;
+    SKP_int16 nBytesPerPacket[MAX_LBRR_DELAY + 1];
+    SKP_uint8* payloadEnd;
+    SKP_uint8 payload[MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES * (MAX_LBRR_DELAY + 1)];
+};
 
-#ifdef _SYSTEM_IS_BIG_ENDIAN
-            swap_endian(&nBytes, 1);
-#endif
+// Decodes the packet at the head of the queue (or conceals it when lost) and drops it from the queue
+static void decoder_decode_packet(SilkDecoder* decoder) {
+    SKP_int16 out[(FRAME_LENGTH_MS * MAX_API_FS_KHZ << 1) * MAX_INPUT_FRAMES];
+    SKP_uint8 FECpayload[MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES];
+    SKP_int16* nBytesPerPacket = decoder->nBytesPerPacket;
+    const SKP_uint8* payloadToDec = decoder->payload;
+    SKP_int16 nBytes = nBytesPerPacket[0], len, totalLen = 0;
+    bool lost = nBytes == 0;
 
-            if (nBytes < 0 || psRead - silk_data >= data_len) {
-                remainPackets = MAX_LBRR_DELAY;
-                goto decode;
+    if (lost) { /* Packet loss. Search after FEC in next packets */
+        const SKP_uint8* payloadPtr = decoder->payload;
+        for (int i = 0; i < MAX_LBRR_DELAY; i++) {
+            if (nBytesPerPacket[i + 1] > 0) {
+                SKP_int16 nBytesFEC = 0;
+                SKP_Silk_SDK_search_for_LBRR(payloadPtr, nBytesPerPacket[i + 1], i + 1, FECpayload, &nBytesFEC);
+                if (nBytesFEC > 0) {
+                    payloadToDec = FECpayload;
+                    nBytes = nBytesFEC;
+                    lost = false;
+                    break;
+                }
             }
-
-            memcpy(payloadEnd, psRead, nBytes); // read payload
-            psRead += sizeof(SKP_uint8) * nBytes;
-
-        }
-        else if (--remainPackets <= 0) {
-            break;
+            payloadPtr += nBytesPerPacket[i + 1];
         }
+    }
 
-        decode:
-          if (nBytesPerPacket[0] != 0) {
-              nBytes = nBytesPerPacket[0];
-              payloadToDec = payload;
-          }
-
-        SKP_int16* outPtr = out;
-        totalLen = 0;
+    // Timed by hand, so the callback below doesn't count as decoding
+    SKP_int16* outPtr = out;
+    const int64_t decode_start = stats_active() ? stats_now_ns() : 0;
+    if (!lost) {
         int frames = 0;
-
         do { /* Decode all frames in the packet */
-            SKP_Silk_SDK_Decode(psDec, &dec_control, 0, payloadToDec, nBytes, outPtr, &len);  /* Decode 20 ms */
+            SKP_Silk_SDK_Decode(decoder->state, &decoder->control, 0, payloadToDec, nBytes, outPtr, &len);  /* Decode 20 ms */
+            stats_count(STATS_FRAMES, 1);
 
             frames++;
             outPtr += len;
@@ -112,142 +182,904 @@ int silk_decode(uint8_t* silk_data, int data_len, cb_codec callback, void* userd
                 totalLen = 0;
                 frames = 0;
             }
-        } while (dec_control.moreInternalDecoderFrames);
+        } while (decoder->control.moreInternalDecoderFrames);
+    } else { /* Conceal enough frames to cover one packet duration */
+        for (int i = 0; i < decoder->control.framesPerPacket; i++) {
+            SKP_Silk_SDK_Decode(decoder->state, &decoder->control, 1, payloadToDec, nBytes, outPtr, &len);
+            stats_count(STATS_FRAMES, 1);
+            outPtr += len;
+            totalLen += len;
+        }
+    }
 
-        /* Write output to file */
 #ifdef _SYSTEM_IS_BIG_ENDIAN
-        swap_endian(out, totalLen);
+    swap_endian(out, totalLen);
 #endif
+    if (decode_start) {
+        stats_record_stage(LAGRANGE_STAGE_SILK_DECODE, decode_start, stats_now_ns());
+        stats_add(STATS_PACKETS, 1);
+    }
 
-        callback(userdata, reinterpret_cast<uint8_t*>(out), sizeof(SKP_int16) * totalLen);
+    if (totalLen > 0) {
+        decoder->callback(decoder->userdata, reinterpret_cast<uint8_t*>(out), sizeof(SKP_int16) * totalLen);
+    }
 
-        /* Update buffer */
-        SKP_int16 totBytes = 0;
-        for (int i = 0; i < MAX_LBRR_DELAY; i++) {
-            totBytes += nBytesPerPacket[i + 1];
+    /* Update buffer */
+    SKP_int32 totBytes = 0;
+    for (int i = 0; i < MAX_LBRR_DELAY; i++) {
+        totBytes += nBytesPerPacket[i + 1];
+    }
+    SKP_memmove(decoder->payload, &decoder->payload[nBytesPerPacket[0]], totBytes * sizeof(SKP_uint8));
+    decoder->payloadEnd -= nBytesPerPacket[0];
+    SKP_memmove(nBytesPerPacket, &nBytesPerPacket[1], MAX_LBRR_DELAY * sizeof(SKP_int16));
+    nBytesPerPacket[MAX_LBRR_DELAY] = 0;
+    decoder->queued--;
+}
+
+// Queues the packet whose payload was just written at payloadEnd, decoding once the LBRR delay is filled
+static void decoder_enqueue_packet(SilkDecoder* decoder, SKP_int16 nBytes) {
+    decoder->nBytesPerPacket[decoder->queued++] = nBytes;
+    decoder->payloadEnd += nBytes;
+    if (decoder->queued > MAX_LBRR_DELAY) {
+        decoder_decode_packet(decoder);
+    }
+}
+
+SilkDecoder* silk_decoder_create_pooled(SilkStatePool* pool, cb_codec callback, void* userdata) {
+    if (!callback) {
+        return nullptr;
+    }
+
+    auto* decoder = new SilkDecoder { };
+    decoder->pool = pool;
+    decoder->state = pool_acquire(pool, false);
+    if (!decoder->state || SKP_Silk_SDK_InitDecoder(decoder->state)) {
+        pool_release(pool, false, decoder->state);
+        delete decoder;
+        return nullptr;
+    }
+
+    decoder->control.framesPerPacket = 1;
+    decoder->control.API_sampleRate = sample_rate;
+    decoder->callback = callback;
+    decoder->userdata = userdata;
+    decoder->packet_size = -1;
+    decoder->payloadEnd = decoder->payload;
+
+    return decoder;
+}
+
+SilkDecoder* silk_decoder_create(cb_codec callback, void* userdata) {
+    return silk_decoder_create_pooled(default_pool(), callback, userdata);
+}
+
+int silk_decoder_push(SilkDecoder* decoder, const uint8_t* silk_data, int len) {
+    if (!decoder || decoder->failed || len < 0 || (!silk_data && len > 0)) {
+        return 1;
+    }
+
+    const uint8_t* psRead = silk_data, * psEnd = silk_data + len;
+    while (psRead < psEnd && !decoder->ended) {
+        if (decoder->header_read < static_cast<SKP_int32>(silk_magic.size())) {
+            if (*psRead++ != static_cast<uint8_t>(silk_magic[decoder->header_read++])) {
+                decoder->failed = true;
+                return 1;
+            }
+            continue;
         }
 
-        if (totBytes < 0 || totBytes > sizeof(payload)) { /* Check if the received totBytes is valid */
-            free(psDec);
-            return 1;
+        if (decoder->packet_size < 0) { // Length prefix, little endian on disk
+            decoder->size_bytes[decoder->size_read++] = *psRead++;
+            if (decoder->size_read < static_cast<SKP_int32>(sizeof(SKP_int16))) {
+                continue;
+            }
+            decoder->size_read = 0;
+
+            const auto nBytes = static_cast<SKP_int16>(decoder->size_bytes[0] | decoder->size_bytes[1] << 8);
+            if (nBytes < 0) {
+                decoder->ended = true;
+                break;
+            }
+            if (nBytes > MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES) { /* Check if the received nBytes is valid */
+                decoder->failed = true;
+                return 1;
+            }
+            if (nBytes == 0) {
+                decoder_enqueue_packet(decoder, 0);
+                if (call_interrupted()) {
+                    decoder->failed = true;
+                    return 1;
+                }
+                continue;
+            }
+            decoder->packet_size = nBytes;
+            decoder->packet_read = 0;
+            continue;
         }
 
-        SKP_memmove(payload, &payload[nBytesPerPacket[0]], totBytes * sizeof(SKP_uint8));
-        payloadEnd -= nBytesPerPacket[0];
-        SKP_memmove(nBytesPerPacket, &nBytesPerPacket[1], MAX_LBRR_DELAY * sizeof(SKP_int16));
+        const auto n = static_cast<SKP_int32>(std::min<std::ptrdiff_t>(decoder->packet_size - decoder->packet_read, psEnd - psRead));
+        memcpy(decoder->payloadEnd + decoder->packet_read, psRead, n);
+        psRead += n;
+        decoder->packet_read += n;
+
+        if (decoder->packet_read == decoder->packet_size) {
+            decoder->packet_size = -1;
+            decoder_enqueue_packet(decoder, static_cast<SKP_int16>(decoder->packet_read));
+            if (call_interrupted()) { // Only inside a call with limits, the streaming API itself has none
+                decoder->failed = true;
+                return 1;
+            }
+        }
     }
 
-    free(psDec);
     return 0;
 }
 
-int silk_encode(uint8_t* pcm_data, int data_len, cb_codec callback, void* userdata) {
-    size_t counter;
-    SKP_int16 n_bytes;
-    SKP_uint8 payload[MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES];
+int silk_decoder_push_packet(SilkDecoder* decoder, const uint8_t* packet, int len) {
+    if (!decoder || decoder->failed || len < 0 || len > MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES || (!packet && len > 0)) {
+        return 1;
+    }
+    if (decoder->packet_size >= 0 || decoder->size_read > 0) { // Can't interleave with a partially pushed byte stream
+        return 1;
+    }
+
+    decoder->header_read = static_cast<SKP_int32>(silk_magic.size());
+    memcpy(decoder->payloadEnd, packet, len);
+    decoder_enqueue_packet(decoder, static_cast<SKP_int16>(len));
+    return 0;
+}
+
+int silk_decoder_flush(SilkDecoder* decoder) {
+    if (!decoder || decoder->failed) {
+        return 1;
+    }
+    if (decoder->header_read < static_cast<SKP_int32>(silk_magic.size())) { // Empty or cut inside the header
+        return 1;
+    }
+
+    /* Empty the receive buffer, a truncated trailing packet is dropped */
+    while (decoder->queued > 0) {
+        if (call_interrupted()) {
+            decoder->failed = true;
+            return 1;
+        }
+        decoder_decode_packet(decoder);
+    }
+    decoder->packet_size = -1;
+    decoder->size_read = 0;
+    decoder->payloadEnd = decoder->payload;
+    return 0;
+}
+
+void silk_decoder_destroy(SilkDecoder* decoder) {
+    if (!decoder) {
+        return;
+    }
+    pool_release(decoder->pool, false, decoder->state);
+    delete decoder;
+}
+
+int silk_decode_pooled(SilkStatePool* pool, uint8_t* silk_data, int data_len, cb_codec callback, void* userdata) {
+    CallScope scope("silk_decode");
+    scope.wrap_output(callback, userdata);
+    SilkDecoder* decoder = silk_decoder_create_pooled(pool, callback, userdata);
+    if (!decoder) {
+        return scope.result(1);
+    }
+
+    stats_count(STATS_BYTES_IN, data_len);
+    int result = silk_decoder_push(decoder, silk_data, data_len);
+    if (result == 0) {
+        result = silk_decoder_flush(decoder);
+    }
+
+    silk_decoder_destroy(decoder);
+    return scope.result(result);
+}
+
+int silk_decode(uint8_t* silk_data, int data_len, cb_codec callback, void* userdata) {
+    return silk_decode_pooled(default_pool(), silk_data, data_len, callback, userdata);
+}
+
+int silk_decode_file(const char* path, cb_codec callback, void* userdata) {
+    MappedFile file;
+    if (!map_input(file, path, true)) {
+        return 1;
+    }
+
+    return silk_decode(file.data(), static_cast<int>(file.size()), callback, userdata);
+}
+
+int silk_decode_io(const LagrangeIoSource* source, cb_codec callback, void* userdata) {
+    CallScope scope("silk_decode");
+    scope.wrap_output(callback, userdata);
+    if (!source || !source->read) {
+        return scope.result(1);
+    }
+
+    SilkDecoder* decoder = silk_decoder_create(callback, userdata);
+    if (!decoder) {
+        return scope.result(1);
+    }
+
+    SKP_uint8 chunk[4096];
+    int result = 0;
+    while (result == 0) {
+        const int n = source->read(source->userdata, chunk, sizeof(chunk));
+        if (n < 0) {
+            result = 1;
+        } else if (n == 0) {
+            result = silk_decoder_flush(decoder);
+            break;
+        } else {
+            stats_count(STATS_BYTES_IN, n);
+            result = silk_decoder_push(decoder, chunk, n);
+        }
+    }
+
+    silk_decoder_destroy(decoder);
+    return scope.result(result);
+}
+
+struct SilkPacketIndex {
+    struct Packet {
+        size_t offset; // Of the length prefix
+        SKP_int32 size;
+        int64_t start_ms;
+    };
+
+    std::vector<Packet> packets;
+    int64_t duration_ms = 0;
+    int64_t payload_bytes = 0;
+    bool truncated = false;
+    bool corrupt = false;
+    size_t end = 0; // Offset the walk stopped at, the damaged packet when corrupt
+};
+
+// Walks the length prefixed packet chain without decoding, frame counts come from the packet TOC
+static bool index_packets(const uint8_t* silk_data, size_t len, SilkPacketIndex& index) {
+    if (!silk_data || len < silk_magic.size() || memcmp(silk_data, silk_magic.data(), silk_magic.size()) != 0) {
+        index.corrupt = true;
+        return false;
+    }
+
+    SKP_int32 frames_per_packet = 1; // A lost packet is concealed with as many frames as the one before
+    size_t offset = silk_magic.size();
+    while (offset < len) {
+        if (len - offset < sizeof(SKP_int16)) {
+            index.truncated = true;
+            break;
+        }
+
+        const auto nBytes = static_cast<SKP_int16>(silk_data[offset] | silk_data[offset + 1] << 8);
+        if (nBytes < 0) { // Stream terminator
+            break;
+        }
+        if (nBytes > MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES) {
+            index.corrupt = true;
+            break;
+        }
+        if (len - offset - sizeof(SKP_int16) < static_cast<size_t>(nBytes)) {
+            index.truncated = true;
+            break;
+        }
+
+        if (nBytes > 0) {
+            SKP_Silk_TOC_struct toc;
+            SKP_Silk_SDK_get_TOC(silk_data + offset + sizeof(SKP_int16), nBytes, &toc);
+            if (toc.corrupt || toc.framesInPacket <= 0 || toc.framesInPacket > MAX_INPUT_FRAMES) {
+                index.corrupt = true;
+                break;
+            }
+            frames_per_packet = toc.framesInPacket;
+        }
+
+        index.packets.push_back({ offset, nBytes, index.duration_ms });
+        index.duration_ms += frames_per_packet * FRAME_LENGTH_MS;
+        index.payload_bytes += nBytes;
+        offset += sizeof(SKP_int16) + nBytes;
+    }
+
+    index.end = offset;
+    return true;
+}
+
+// Longest output the decoder can produce from the packets at offset onwards. It doesn't look at the TOC,
+// so it keeps decoding (or concealing) every complete packet until a terminator or an invalid length.
+static int64_t decoder_tail_ms(const uint8_t* silk_data, size_t len, size_t offset) {
+    int64_t duration_ms = 0;
+    while (len - offset >= sizeof(SKP_int16)) {
+        const auto nBytes = static_cast<SKP_int16>(silk_data[offset] | silk_data[offset + 1] << 8);
+        if (nBytes < 0 || nBytes > MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES ||
+            len - offset - sizeof(SKP_int16) < static_cast<size_t>(nBytes)) {
+            break;
+        }
+        duration_ms += FRAME_LENGTH_MS * MAX_INPUT_FRAMES;
+        offset += sizeof(SKP_int16) + nBytes;
+    }
+    return duration_ms;
+}
+
+int silk_probe(const uint8_t* silk_data, int len, SilkProbeInfo* info) {
+    if (!info || len < 0) {
+        return 1;
+    }
+
+    SilkPacketIndex index;
+    const bool valid = index_packets(silk_data, len, index);
+    info->packets = static_cast<int>(index.packets.size());
+    info->durationMs = index.duration_ms;
+    info->averageBitrate = index.duration_ms > 0 ? static_cast<int>(index.payload_bytes * 8 * 1000 / index.duration_ms) : 0;
+    info->truncated = index.truncated;
+    info->corrupt = index.corrupt;
+    return valid ? 0 : 1;
+}
+
+int silk_probe_file(const char* path, SilkProbeInfo* info) {
+    MappedFile file;
+    if (!map_input(file, path, true)) {
+        return 1;
+    }
+
+    return silk_probe(file.data(), static_cast<int>(file.size()), info);
+}
+
+int silk_decode_max_output_size(const uint8_t* silk_data, int len) {
+    SilkPacketIndex index;
+    if (len < 0 || !index_packets(silk_data, len, index)) {
+        return LAGRANGE_ERROR_FAILED;
+    }
+
+    // The index stops at a packet with a damaged TOC, the decoder goes on through the rest of the stream
+    int64_t duration_ms = index.duration_ms;
+    if (index.corrupt) {
+        duration_ms += decoder_tail_ms(silk_data, len, index.end);
+    }
+    const int64_t size = duration_ms * (sample_rate / 1000) * static_cast<int64_t>(sizeof(SKP_int16));
+    return size > INT_MAX ? LAGRANGE_ERROR_FAILED : static_cast<int>(size);
+}
+
+int silk_decode_into(uint8_t* silk_data, int len, uint8_t* out, int out_capacity) {
+    if (!out || out_capacity < 0) {
+        return LAGRANGE_ERROR_FAILED;
+    }
+
+    BufferWriter writer = { out, out_capacity, 0, false };
+    return buffer_writer_result(writer, silk_decode(silk_data, len, buffer_writer_write, &writer));
+}
+
+// Drops the decoded samples outside [first_sample, last_sample) before they reach the caller
+struct RangeSink {
+    cb_codec* callback;
+    void* userdata;
+    int64_t position; // In samples
+    int64_t first_sample;
+    int64_t last_sample;
+};
+
+static void trim_to_range(void* userdata, const uint8_t* p, int len) {
+    auto* sink = static_cast<RangeSink*>(userdata);
+    const int64_t samples = len / static_cast<int>(sizeof(SKP_int16));
+    const int64_t begin = std::max(sink->position, sink->first_sample);
+    const int64_t end = std::min(sink->position + samples, sink->last_sample);
+    if (begin < end) {
+        sink->callback(sink->userdata, p + (begin - sink->position) * sizeof(SKP_int16),
+                       static_cast<int>((end - begin) * sizeof(SKP_int16)));
+    }
+    sink->position += samples;
+}
+
+int silk_decode_range(uint8_t* silk_data, int data_len, int64_t start_ms, int64_t end_ms,
+                      cb_codec callback, void* userdata) {
+    CallScope scope("silk_decode_range");
+    scope.wrap_output(callback, userdata);
+    SilkPacketIndex index;
+    if (!callback || data_len < 0 || start_ms < 0 || !index_packets(silk_data, data_len, index)) {
+        return scope.result(1);
+    }
+    if (end_ms <= 0 || end_ms > index.duration_ms) {
+        end_ms = index.duration_ms;
+    }
+    if (start_ms >= end_ms) {
+        return scope.result(0);
+    }
+
+    // The first packet that reaches into the range, backed off by a few packets so the decoder settles
+    const auto& packets = index.packets;
+    const auto first = std::upper_bound(packets.begin(), packets.end(), start_ms,
+        [](int64_t ms, const SilkPacketIndex::Packet& packet) { return ms < packet.start_ms; }) - packets.begin() - 1;
+    const auto preroll = std::max<std::ptrdiff_t>(0, first - RANGE_PREROLL_PACKETS);
+    const auto last = std::lower_bound(packets.begin(), packets.end(), end_ms,
+        [](const SilkPacketIndex::Packet& packet, int64_t ms) { return packet.start_ms < ms; }) - packets.begin();
+
+    constexpr int64_t samples_per_ms = sample_rate / 1000;
+    RangeSink sink = { callback, userdata, packets[preroll].start_ms * samples_per_ms,
+                       start_ms * samples_per_ms, end_ms * samples_per_ms };
+
+    SilkDecoder* decoder = silk_decoder_create(trim_to_range, &sink);
+    if (!decoder) {
+        return scope.result(1);
+    }
+
+    const size_t begin = packets[preroll].offset;
+    const size_t end = last < static_cast<std::ptrdiff_t>(packets.size()) ? packets[last].offset
+                                                                          : packets.back().offset + sizeof(SKP_int16) + packets.back().size;
+    stats_count(STATS_BYTES_IN, static_cast<int64_t>(end - begin));
+    int result = silk_decoder_push(decoder, reinterpret_cast<const uint8_t*>(silk_magic.data()), static_cast<int>(silk_magic.size()));
+    if (result == 0) {
+        result = silk_decoder_push(decoder, silk_data + begin, static_cast<int>(end - begin));
+    }
+    if (result == 0) {
+        result = silk_decoder_flush(decoder);
+    }
+
+    silk_decoder_destroy(decoder);
+    return scope.result(result);
+}
+
+struct SilkEncoder {
+    void* state;
+    SilkStatePool* pool;
+    SKP_SILK_SDK_EncControlStruct control;
+    cb_codec* callback;
+    void* userdata;
+    SKP_int32 frame_bytes; // Bytes of PCM in one 20 ms frame
+    SKP_int32 buffered; // Bytes of the current frame received so far
+    SKP_int32 smpls_since_last_packet;
+    SKP_int32 skip_packets; // Warm-up packets that are encoded but not written
+    SKP_int32 channels; // Of the pushed PCM, stereo is downmixed before it reaches in
+    uint8_t carry[4]; // Bytes of a stereo sample split across pushes
+    SKP_int32 carried;
     SKP_int16 in[FRAME_LENGTH_MS * MAX_API_FS_KHZ * MAX_INPUT_FRAMES];
-    SKP_int32 enc_size_bytes, result;
-    unsigned char* ps_read = pcm_data, *ps_read_end = pcm_data + data_len;
-    void* ps_enc = nullptr;
+};
+
+static int encoder_encode_frame(SilkEncoder* encoder) {
+    if (call_interrupted()) return 1; // Checked per frame, so a stopped call ends within one
+
+    // Length prefix and payload go out in a single callback
+    SKP_uint8 packet[sizeof(SKP_int16) + MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES];
+    SKP_uint8* payload = packet + sizeof(SKP_int16);
+    SKP_int16 n_bytes = MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES;
+    const SKP_int32 api_fs_hz = encoder->control.API_sampleRate;
+    const SKP_int32 counter = encoder->frame_bytes / static_cast<SKP_int32>(sizeof(SKP_int16));
 
 #ifdef _SYSTEM_IS_BIG_ENDIAN
-    SKP_int16 n_bytes_le;
+    swap_endian(encoder->in, counter);
 #endif
 
-    // Default settings
-    SKP_int32 api_fs_hz = sample_rate;
-    SKP_int32 max_internal_fs_hz = 0;
-    SKP_int32 target_rate_bps = 24000;
-    SKP_int32 smpls_since_last_packet, packet_size_ms = 20;
-
-    if (max_internal_fs_hz == 0) {
-        max_internal_fs_hz = 24000;
-        if (api_fs_hz < max_internal_fs_hz) {
-            max_internal_fs_hz = api_fs_hz;
+    encoder->buffered = 0;
+    {
+        StageTimer timer(LAGRANGE_STAGE_SILK_ENCODE);
+        if (SKP_Silk_SDK_Encode(encoder->state, &encoder->control, encoder->in, counter, payload, &n_bytes)) {
+            return 1;
         }
     }
+    stats_count(STATS_FRAMES, 1);
+    const SKP_int32 packet_size_ms = 1000 * encoder->control.packetSize / api_fs_hz;
+
+    encoder->smpls_since_last_packet += counter;
+    if (1000 * encoder->smpls_since_last_packet / api_fs_hz == packet_size_ms && encoder->skip_packets > 0) {
+        encoder->skip_packets--;
+        encoder->smpls_since_last_packet = 0;
+    } else if (1000 * encoder->smpls_since_last_packet / api_fs_hz == packet_size_ms) {
+        // Payload size, little endian on every host
+        packet[0] = static_cast<SKP_uint8>(n_bytes & 0xFF);
+        packet[1] = static_cast<SKP_uint8>((n_bytes >> 8) & 0xFF);
+        stats_count(STATS_PACKETS, 1);
+        encoder->callback(encoder->userdata, packet, static_cast<int>(sizeof(SKP_int16) + n_bytes));
+
+        encoder->smpls_since_last_packet = 0;
+    }
+
+    return 0;
+}
 
 #if LOW_COMPLEXITY_ONLY
-    SKP_int32 complexity_mode = 0;
+constexpr SKP_int32 max_complexity = 0;
 #else
-    SKP_int32 complexity_mode = 2;
+constexpr SKP_int32 max_complexity = 2;
 #endif
 
+// Rates the SDK resamples from natively
+static bool valid_input_rate(SKP_int32 rate) {
+    return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 ||
+           rate == 32000 || rate == 44100 || rate == 48000;
+}
+
+static SKP_int32 input_rate_of(const SilkEncoderOptions& options) {
+    return options.sampleRate > 0 ? options.sampleRate : sample_rate;
+}
+
+static SKP_int32 input_channels_of(const SilkEncoderOptions& options) {
+    return options.channels > 0 ? options.channels : 1;
+}
+
+// Bytes of pushed PCM in one 20 ms frame
+static int64_t input_frame_bytes(const SilkEncoderOptions& options) {
+    return FRAME_LENGTH_MS * input_rate_of(options) / 1000 * input_channels_of(options) * static_cast<int64_t>(sizeof(SKP_int16));
+}
+
+// The settings silk_encode has always used
+static SilkEncoderOptions default_encoder_options() {
+    SilkEncoderOptions options = { };
+    options.complexity = max_complexity;
+    options.bitRate = 24000;
+    options.packetSize = 20;
+    options.useInBandFEC = 0;
+    options.useDTX = 0;
+    options.maxInternalSampleRate = 24000;
+    options.packetLossPercentage = 0;
+    options.sampleRate = sample_rate;
+    options.channels = 1;
+    return options;
+}
+
+int silk_encoder_options_preset(const char* name, SilkEncoderOptions* options) {
+    if (!name || !options) {
+        return 1;
+    }
+
+    *options = default_encoder_options();
+    const std::string_view preset = name;
+    if (preset == "default") { // Same as silk_encode
+        return 0;
+    }
+    if (preset == "fast") { // Cheapest analysis and a 16 kHz internal rate
+        options->complexity = 0;
+        options->bitRate = 16000;
+        options->maxInternalSampleRate = 16000;
+    } else if (preset == "balanced") {
+        options->complexity = std::min<SKP_int32>(1, max_complexity);
+    } else if (preset == "quality") {
+        options->complexity = max_complexity;
+        options->bitRate = 32000;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+// Internal rate cap handed to the SDK, never above the input rate
+static SKP_int32 max_internal_rate_of(const SilkEncoderOptions& options) {
+    const SKP_int32 max_internal_fs_hz = options.maxInternalSampleRate != 0 ? options.maxInternalSampleRate : 24000;
+    return std::min(max_internal_fs_hz, input_rate_of(options));
+}
+
+// Everything the encoder checks before it takes a state, shared with the size estimate
+static bool valid_encoder_options(const SilkEncoderOptions& settings) {
+    const SKP_int32 packet_size_ms = settings.packetSize;
+    const SKP_int32 max_internal_fs_hz = max_internal_rate_of(settings);
+    if (!valid_input_rate(input_rate_of(settings)) || input_channels_of(settings) > 2) {
+        return false;
+    }
+    if (settings.complexity < 0 || settings.complexity > max_complexity || settings.bitRate < 0 ||
+        packet_size_ms < FRAME_LENGTH_MS || packet_size_ms > FRAME_LENGTH_MS * MAX_INPUT_FRAMES || packet_size_ms % FRAME_LENGTH_MS ||
+        settings.packetLossPercentage < 0 || settings.packetLossPercentage > 100) {
+        return false;
+    }
+    return max_internal_fs_hz == 8000 || max_internal_fs_hz == 12000 || max_internal_fs_hz == 16000 || max_internal_fs_hz == 24000;
+}
+
+// write_header is off for the segments of silk_encode_parallel, which are stitched under one header
+static SilkEncoder* encoder_create(SilkStatePool* pool, const SilkEncoderOptions* options,
+                                   cb_codec callback, void* userdata, bool write_header = true) {
+    const SilkEncoderOptions settings = options ? *options : default_encoder_options();
+    const SKP_int32 api_fs_hz = input_rate_of(settings);
+    const SKP_int32 max_internal_fs_hz = max_internal_rate_of(settings);
+    const SKP_int32 packet_size_ms = settings.packetSize;
+
+    if (!callback || !valid_encoder_options(settings)) {
+        return nullptr;
+    }
+
+    auto* encoder = new SilkEncoder { };
     SKP_SILK_SDK_EncControlStruct enc_status = { }; // Struct for status of encoder
-    SKP_SILK_SDK_EncControlStruct enc_control = { }; // Struct for input to encoder
-
-    enc_control.API_sampleRate = sample_rate;
-    enc_control.maxInternalSampleRate = max_internal_fs_hz;
-    enc_control.packetSize = (packet_size_ms * sample_rate) / 1000;
-    enc_control.packetLossPercentage = 0;
-    enc_control.useInBandFEC = 0;
-    enc_control.useDTX = 0;
-    enc_control.complexity = complexity_mode;
-    enc_control.bitRate = (target_rate_bps > 0 ? target_rate_bps : 0);
-
-    if (api_fs_hz > MAX_API_FS_KHZ * 1000 || api_fs_hz < 0) {
+
+    encoder->pool = pool;
+    encoder->state = pool_acquire(pool, true);
+    if (!encoder->state || SKP_Silk_SDK_InitEncoder(encoder->state, &enc_status)) {
+        pool_release(pool, true, encoder->state);
+        delete encoder;
+        return nullptr;
+    }
+
+    encoder->control.API_sampleRate = api_fs_hz;
+    encoder->control.maxInternalSampleRate = max_internal_fs_hz;
+    encoder->control.packetSize = (packet_size_ms * api_fs_hz) / 1000;
+    encoder->control.packetLossPercentage = settings.packetLossPercentage;
+    encoder->control.useInBandFEC = settings.useInBandFEC != 0;
+    encoder->control.useDTX = settings.useDTX != 0;
+    encoder->control.complexity = settings.complexity;
+    encoder->control.bitRate = settings.bitRate;
+
+    encoder->callback = callback;
+    encoder->userdata = userdata;
+    encoder->frame_bytes = FRAME_LENGTH_MS * api_fs_hz / 1000 * static_cast<SKP_int32>(sizeof(SKP_int16));
+    encoder->channels = input_channels_of(settings);
+
+    if (write_header) {
+        callback(userdata, reinterpret_cast<const std::uint8_t*>(silk_magic.data()), silk_magic.size());
+    }
+
+    return encoder;
+}
+
+SilkEncoder* silk_encoder_create(cb_codec callback, void* userdata) {
+    return encoder_create(default_pool(), nullptr, callback, userdata);
+}
+
+SilkEncoder* silk_encoder_create_pooled(SilkStatePool* pool, cb_codec callback, void* userdata) {
+    return encoder_create(pool, nullptr, callback, userdata);
+}
+
+SilkEncoder* silk_encoder_create_ex(const SilkEncoderOptions* options, cb_codec callback, void* userdata) {
+    return encoder_create(default_pool(), options, callback, userdata);
+}
+
+// Downmixes whole stereo samples into the frame, a sample split across pushes waits in carry
+static int encoder_push_stereo(SilkEncoder* encoder, const uint8_t* pcm_data, int len) {
+    auto* frame = reinterpret_cast<uint8_t*>(encoder->in);
+    constexpr int sample_bytes = 2 * sizeof(SKP_int16);
+
+    if (encoder->carried > 0) {
+        const int n = std::min(len, sample_bytes - encoder->carried);
+        memcpy(encoder->carry + encoder->carried, pcm_data, n);
+        encoder->carried += n;
+        pcm_data += n;
+        len -= n;
+        if (encoder->carried < sample_bytes) return 0;
+
+        encoder->carried = 0;
+        downmix_stereo(encoder->carry, frame + encoder->buffered, 1);
+        encoder->buffered += sizeof(SKP_int16);
+        if (encoder->buffered == encoder->frame_bytes && encoder_encode_frame(encoder)) {
+            return 1;
+        }
+    }
+
+    while (len >= sample_bytes) {
+        const int samples = std::min(len / sample_bytes, (encoder->frame_bytes - encoder->buffered) / static_cast<int>(sizeof(SKP_int16)));
+        downmix_stereo(pcm_data, frame + encoder->buffered, samples);
+        encoder->buffered += samples * static_cast<int>(sizeof(SKP_int16));
+        pcm_data += samples * sample_bytes;
+        len -= samples * sample_bytes;
+
+        if (encoder->buffered == encoder->frame_bytes && encoder_encode_frame(encoder)) {
+            return 1;
+        }
+    }
+
+    memcpy(encoder->carry, pcm_data, len);
+    encoder->carried = len;
+    return 0;
+}
+
+int silk_encoder_push(SilkEncoder* encoder, const uint8_t* pcm_data, int len) {
+    if (!encoder || len < 0 || (!pcm_data && len > 0)) {
         return 1;
     }
+    if (encoder->channels == 2) {
+        return encoder_push_stereo(encoder, pcm_data, len);
+    }
 
-    callback(userdata, reinterpret_cast<const std::uint8_t*>(silk_magic.data()), silk_magic.size());
+    auto* frame = reinterpret_cast<uint8_t*>(encoder->in);
+    while (len > 0) {
+        const int n = std::min(len, encoder->frame_bytes - encoder->buffered);
+        memcpy(frame + encoder->buffered, pcm_data, n);
+        encoder->buffered += n;
+        pcm_data += n;
+        len -= n;
+
+        if (encoder->buffered == encoder->frame_bytes && encoder_encode_frame(encoder)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
 
-    result = SKP_Silk_SDK_Get_Encoder_Size(&enc_size_bytes);
-    if (result) {
+int silk_encoder_flush(SilkEncoder* encoder) {
+    if (!encoder) {
         return 1;
     }
+    if (encoder->buffered == 0 && encoder->smpls_since_last_packet == 0) {
+        return 0;
+    }
+
+    // Pad the trailing partial frame with silence, then add silent frames until a packet of
+    // more than 20 ms is complete, otherwise the SDK would keep its frames to itself
+    auto* frame = reinterpret_cast<uint8_t*>(encoder->in);
+    do {
+        memset(frame + encoder->buffered, 0x00, encoder->frame_bytes - encoder->buffered);
+        if (encoder_encode_frame(encoder)) {
+            return 1;
+        }
+    } while (encoder->smpls_since_last_packet != 0);
+
+    return 0;
+}
+
+void silk_encoder_destroy(SilkEncoder* encoder) {
+    if (!encoder) {
+        return;
+    }
+    pool_release(encoder->pool, true, encoder->state);
+    delete encoder;
+}
 
-    ps_enc = malloc(enc_size_bytes);
-    result = SKP_Silk_SDK_InitEncoder(ps_enc, &enc_status);
-    if (result) {
-        free(ps_enc);
+static int encode(SilkStatePool* pool, const SilkEncoderOptions* options, uint8_t* pcm_data, int data_len,
+                  cb_codec callback, void* userdata) {
+    CallScope scope("silk_encode");
+    scope.wrap_output(callback, userdata);
+    SilkEncoder* encoder = encoder_create(pool, options, callback, userdata);
+    if (!encoder) {
+        return scope.result(1);
+    }
+
+    stats_count(STATS_BYTES_IN, data_len);
+    int result = silk_encoder_push(encoder, pcm_data, data_len);
+    if (result == 0) {
+        result = silk_encoder_flush(encoder);
+    }
+
+    silk_encoder_destroy(encoder);
+    return scope.result(result);
+}
+
+int silk_encode(uint8_t* pcm_data, int data_len, cb_codec callback, void* userdata) {
+    return encode(default_pool(), nullptr, pcm_data, data_len, callback, userdata);
+}
+
+int silk_encode_pooled(SilkStatePool* pool, uint8_t* pcm_data, int data_len, cb_codec callback, void* userdata) {
+    return encode(pool, nullptr, pcm_data, data_len, callback, userdata);
+}
+
+int silk_encode_ex(uint8_t* pcm_data, int data_len, const SilkEncoderOptions* options,
+                   cb_codec callback, void* userdata) {
+    return encode(default_pool(), options, pcm_data, data_len, callback, userdata);
+}
+
+int silk_encode_file(const char* path, const SilkEncoderOptions* options, cb_codec callback, void* userdata) {
+    MappedFile file;
+    if (!map_input(file, path, true)) {
         return 1;
     }
 
-    smpls_since_last_packet = 0;
+    return encode(default_pool(), options, file.data(), static_cast<int>(file.size()), callback, userdata);
+}
 
-    while (true) {
-        SKP_int32 frame_size_read_from_file_ms = 20;
-        if (ps_read - pcm_data >= data_len) {
-            break;
-        }
+int silk_encode_max_output_size(int len, const SilkEncoderOptions* options) {
+    const SilkEncoderOptions settings = options ? *options : default_encoder_options();
+    if (len < 0 || !valid_encoder_options(settings)) { // Options the encoder would reject have no size
+        return LAGRANGE_ERROR_FAILED;
+    }
+
+    // The target bitrate is only an average, so every frame is counted at the most the SDK may emit
+    const int64_t frame_bytes = input_frame_bytes(settings);
+    const int64_t frames_per_packet = settings.packetSize / FRAME_LENGTH_MS;
+    const int64_t frames = (len + frame_bytes - 1) / frame_bytes;
+    const int64_t packets = (frames + frames_per_packet - 1) / frames_per_packet;
+    const int64_t size = static_cast<int64_t>(silk_magic.size()) +
+                         packets * (static_cast<int64_t>(sizeof(SKP_int16)) + frames_per_packet * MAX_BYTES_PER_FRAME);
+    return size > INT_MAX ? LAGRANGE_ERROR_FAILED : static_cast<int>(size);
+}
+
+int silk_encode_into(uint8_t* pcm_data, int len, const SilkEncoderOptions* options, uint8_t* out, int out_capacity) {
+    if (!out || out_capacity < 0) {
+        return LAGRANGE_ERROR_FAILED;
+    }
+
+    BufferWriter writer = { out, out_capacity, 0, false };
+    return buffer_writer_result(writer, encode(default_pool(), options, pcm_data, len, buffer_writer_write, &writer));
+}
+
+struct ParallelEncode {
+    struct Segment {
+        const uint8_t* warm_begin; // Encoded from here, packets before begin only warm the state up
+        const uint8_t* begin;
+        const uint8_t* end;
+        std::vector<uint8_t> out;
+        int result;
+    };
+
+    SilkEncoderOptions options;
+    bool has_options;
+    CallContext context; // Of the calling thread, the pool threads report to and stop with it as well
+    std::vector<Segment> segments;
+    std::atomic<size_t> next { 0 };
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t finished = 0;
+};
 
-        counter = frame_size_read_from_file_ms * api_fs_hz / 1000;
-        if (counter * sizeof(SKP_int16) > ps_read_end - ps_read) {
-            memset(in, 0x00, sizeof(in));
-            size_t realrd = (ps_read_end - ps_read);
-            memcpy(in, ps_read, realrd);
-            ps_read += realrd;
+static void collect_segment(void* userdata, const uint8_t* p, int len) {
+    auto* out = static_cast<std::vector<uint8_t>*>(userdata);
+    out->insert(out->end(), p, p + len);
+}
+
+static void encode_segments(const std::shared_ptr<ParallelEncode>& job) {
+    CallAdopt adopt(job->context);
+    size_t index;
+    while ((index = job->next++) < job->segments.size()) {
+        auto& segment = job->segments[index];
+        const int64_t packet_bytes = input_frame_bytes(job->options) * (job->options.packetSize / FRAME_LENGTH_MS);
+
+        SilkEncoder* encoder = encoder_create(default_pool(), job->has_options ? &job->options : nullptr,
+                                              collect_segment, &segment.out, false);
+        if (!encoder) {
+            segment.result = 1;
         } else {
-            size_t realrd = counter * sizeof(SKP_int16);
-            memcpy(in, ps_read, realrd);
-            ps_read += realrd;
+            encoder->skip_packets = static_cast<SKP_int32>((segment.begin - segment.warm_begin) / packet_bytes);
+            segment.result = silk_encoder_push(encoder, segment.warm_begin, static_cast<int>(segment.end - segment.warm_begin));
+            if (segment.result == 0) {
+                segment.result = silk_encoder_flush(encoder); // Only the last segment has a partial packet to pad
+            }
+            silk_encoder_destroy(encoder);
         }
 
-#ifdef _SYSTEM_IS_BIG_ENDIAN
-        swap_endian(in, counter);
-#endif
+        std::lock_guard lock(job->mutex);
+        if (++job->finished == job->segments.size()) {
+            job->done.notify_all();
+        }
+    }
+}
 
-        n_bytes = MAX_BYTES_PER_FRAME * MAX_INPUT_FRAMES;
-        SKP_Silk_SDK_Encode(ps_enc, &enc_control, in, static_cast<short>(counter), payload, &n_bytes);
-        packet_size_ms = 1000 * enc_control.packetSize / enc_control.API_sampleRate;
+int silk_encode_parallel(uint8_t* pcm_data, int data_len, const SilkEncoderOptions* options, int segments,
+                         cb_codec callback, void* userdata) {
+    CallScope scope("silk_encode_parallel");
+    scope.wrap_output(callback, userdata);
+    auto job = std::make_shared<ParallelEncode>();
+    job->options = options ? *options : default_encoder_options();
+    job->has_options = options != nullptr;
+    if (!callback || !pcm_data || data_len < 0 || !valid_encoder_options(job->options)) {
+        return scope.result(1);
+    }
 
-        smpls_since_last_packet += static_cast<int>(counter);
-        if (1000 * smpls_since_last_packet / api_fs_hz == packet_size_ms) {
-            // Write payload size
-#ifdef _SYSTEM_IS_BIG_ENDIAN
-            n_bytes_le = n_bytes;
-            swap_endian(&n_bytes_le, 1);
-            callback(userdata, (void*)&n_bytes_le, sizeof(SKP_int16));
-#else
-            callback(userdata, static_cast<uint8_t *>((void*)&n_bytes), sizeof(SKP_int16));
-#endif
-            // Write payload
-            callback(userdata, payload, sizeof(SKP_uint8) * n_bytes);
+    // Segments are cut at packet boundaries and are at least PARALLEL_MIN_SEGMENT_MS long
+    const auto pool = ThreadPool::shared();
+    const int64_t packet_bytes = input_frame_bytes(job->options) * (job->options.packetSize / FRAME_LENGTH_MS);
+    const int64_t total_packets = (data_len + packet_bytes - 1) / packet_bytes;
+    const int64_t max_segments = total_packets * job->options.packetSize / PARALLEL_MIN_SEGMENT_MS;
+    const int64_t count = std::min<int64_t>(segments > 0 ? segments : pool->size(), max_segments);
+    if (count <= 1) {
+        return scope.result(encode(default_pool(), options, pcm_data, data_len, callback, userdata));
+    }
 
-            smpls_since_last_packet = 0;
+    const int64_t segment_packets = (total_packets + count - 1) / count;
+    const int64_t warmup_packets = (PARALLEL_WARMUP_MS + job->options.packetSize - 1) / job->options.packetSize;
+    for (int64_t first = 0; first < total_packets; first += segment_packets) {
+        const int64_t warm_first = std::max<int64_t>(0, first - warmup_packets);
+        job->segments.push_back({
+            pcm_data + warm_first * packet_bytes,
+            pcm_data + first * packet_bytes,
+            pcm_data + std::min<int64_t>(data_len, (first + segment_packets) * packet_bytes),
+            { }, 0
+        });
+    }
+
+    // The calling thread takes segments too, so this never waits on a pool that is busy with its caller
+    job->context = call_context();
+    stats_count(STATS_BYTES_IN, data_len);
+    for (size_t i = 1; i < job->segments.size(); i++) {
+        pool->submit([job] { encode_segments(job); });
+    }
+    encode_segments(job);
+    {
+        std::unique_lock lock(job->mutex);
+        job->done.wait(lock, [&] { return job->finished == job->segments.size(); });
+    }
+
+    for (const auto& segment : job->segments) {
+        if (segment.result != 0) {
+            return scope.result(1);
         }
     }
 
-    free(ps_enc);
-    return 0;
-}
\ No newline at end of file
+    callback(userdata, reinterpret_cast<const std::uint8_t*>(silk_magic.data()), silk_magic.size());
+    for (const auto& segment : job->segments) {
+        if (!segment.out.empty()) {
+            callback(userdata, segment.out.data(), static_cast<int>(segment.out.size()));
+        }
+    }
+    return scope.result(0);
+}
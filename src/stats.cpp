@@ -0,0 +1,283 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "instrument.h"
+
+std::atomic<int> stats_flags { 0 };
+std::atomic<int> stats_attached { 0 };
+
+// Initial exec, so lagrange_stats_count_allocation never allocates the TLS block from inside a malloc hook
+#if defined(__GNUC__)
+static thread_local __attribute__((tls_model("initial-exec"))) int64_t thread_allocations = 0;
+#else
+static thread_local int64_t thread_allocations = 0;
+#endif
+
+namespace {
+    thread_local LagrangeCallStats* current_stats = nullptr;
+    thread_local int call_depth = 0; // Nested CallScopes, and the call a worker thread was adopted by
+
+    void add_to(int64_t& field, int64_t n) {
+        // Workers of the same call may report at the same time
+        std::atomic_ref(field).fetch_add(n, std::memory_order_relaxed);
+    }
+
+    struct LatencyCounters {
+        std::atomic<int64_t> count;
+        std::atomic<int64_t> total_ns;
+        std::atomic<int64_t> max_ns;
+        std::atomic<int64_t> histogram[LAGRANGE_STATS_BUCKETS];
+    };
+
+    struct GlobalCounters {
+        LatencyCounters calls;
+        LatencyCounters stages[LAGRANGE_STAGE_COUNT];
+        std::atomic<int64_t> failures;
+        std::atomic<int64_t> counters[STATS_PACKETS + 1]; // StatsCounter
+    };
+
+    GlobalCounters global { };
+
+    void record_latency(LatencyCounters& latency, int64_t ns) {
+        const uint64_t us = static_cast<uint64_t>(ns) / 1000;
+        const int bucket = std::min(static_cast<int>(std::bit_width(us)), LAGRANGE_STATS_BUCKETS - 1);
+        latency.count.fetch_add(1, std::memory_order_relaxed);
+        latency.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        latency.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+        int64_t max = latency.max_ns.load(std::memory_order_relaxed);
+        while (ns > max && !latency.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+    }
+
+    void read_latency(const LatencyCounters& latency, LagrangeLatencyStats& out) {
+        out.count = latency.count.load(std::memory_order_relaxed);
+        out.totalNs = latency.total_ns.load(std::memory_order_relaxed);
+        out.maxNs = latency.max_ns.load(std::memory_order_relaxed);
+        for (int i = 0; i < LAGRANGE_STATS_BUCKETS; i++) {
+            out.histogram[i] = latency.histogram[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    void clear_latency(LatencyCounters& latency) {
+        latency.count = 0;
+        latency.total_ns = 0;
+        latency.max_ns = 0;
+        for (auto& bucket : latency.histogram) {
+            bucket = 0;
+        }
+    }
+
+    struct TraceEvent {
+        const char* name; // Static strings only
+        const char* category;
+        uint32_t tid;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    std::mutex trace_mutex;
+    std::vector<TraceEvent> trace_events;
+    int64_t trace_dropped = 0;
+
+    uint32_t trace_tid() {
+        static std::atomic<uint32_t> next_tid { 1 };
+        thread_local const uint32_t tid = next_tid++;
+        return tid;
+    }
+
+    void record_span(const char* name, const char* category, int64_t start_ns, int64_t end_ns) {
+        const TraceEvent event = { name, category, trace_tid(), start_ns, end_ns - start_ns };
+        std::lock_guard lock(trace_mutex);
+        if (trace_events.size() >= LAGRANGE_TRACE_MAX_EVENTS) {
+            trace_dropped++;
+            return;
+        }
+        trace_events.push_back(event);
+    }
+
+    const char* const stage_names[LAGRANGE_STAGE_COUNT] = {
+        "probe", "demux", "decode", "resample", "silk_encode", "silk_decode", "scale", "image_encode",
+    };
+}
+
+int64_t stats_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void stats_record_stage(LagrangeStage stage, int64_t start_ns, int64_t end_ns) {
+    const int flags = stats_flags.load(std::memory_order_relaxed);
+    if (current_stats) {
+        add_to(current_stats->stageNs[stage], end_ns - start_ns);
+    }
+    if (flags & LAGRANGE_STATS_AGGREGATE) {
+        record_latency(global.stages[stage], end_ns - start_ns);
+    }
+    if (flags & LAGRANGE_STATS_TRACE) {
+        record_span(stage_names[stage], "stage", start_ns, end_ns);
+    }
+}
+
+void stats_add(StatsCounter counter, int64_t n) {
+    if (current_stats) {
+        switch (counter) {
+            case STATS_BYTES_IN: add_to(current_stats->bytesIn, n); break;
+            case STATS_BYTES_OUT: add_to(current_stats->bytesOut, n); break;
+            case STATS_FRAMES: add_to(current_stats->frames, n); break;
+            case STATS_PACKETS: add_to(current_stats->packets, n); break;
+        }
+    }
+    if (stats_flags.load(std::memory_order_relaxed) & LAGRANGE_STATS_AGGREGATE) {
+        global.counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+CallContext call_context() {
+    return { current_stats, active_limits };
+}
+
+CallAdopt::CallAdopt(const CallContext& context) : previous_stats(current_stats), previous_limits(active_limits) {
+    current_stats = context.stats;
+    active_limits = context.limits;
+    call_depth++;
+}
+
+CallAdopt::~CallAdopt() {
+    call_depth--;
+    current_stats = previous_stats;
+    active_limits = previous_limits;
+}
+
+CallScope::CallScope(const char* name) : name(name) {
+    if (call_depth++ > 0) return;
+
+    outermost = true;
+    if (call_limits_arm(limits)) {
+        active_limits = &limits;
+    }
+    if (!stats_active()) return;
+
+    start = stats_now_ns();
+    allocations = thread_allocations;
+}
+
+CallScope::~CallScope() {
+    call_depth--;
+    if (outermost) {
+        active_limits = nullptr;
+    }
+    if (!start) return;
+
+    const int64_t end = stats_now_ns();
+    if (current_stats) {
+        add_to(current_stats->calls, 1);
+        add_to(current_stats->totalNs, end - start);
+        add_to(current_stats->bytesOut, bytes_out);
+        add_to(current_stats->allocations, thread_allocations - allocations);
+    }
+
+    const int flags = stats_flags.load(std::memory_order_relaxed);
+    if (flags & LAGRANGE_STATS_AGGREGATE) {
+        record_latency(global.calls, end - start);
+        global.counters[STATS_BYTES_OUT].fetch_add(bytes_out, std::memory_order_relaxed);
+        if (failed) global.failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (flags & LAGRANGE_STATS_TRACE) {
+        record_span(name, "call", start, end);
+    }
+}
+
+void CallScope::wrap_output(cb_codec*& output, void*& output_userdata) {
+    if (!start || !output) return;
+
+    callback = output;
+    userdata = output_userdata;
+    output = count_output;
+    output_userdata = this;
+}
+
+void CallScope::count_output(void* userdata, const uint8_t* p, int len) {
+    auto* scope = static_cast<CallScope*>(userdata);
+    scope->bytes_out += len;
+    scope->callback(scope->userdata, p, len);
+}
+
+void lagrange_stats_attach(LagrangeCallStats* stats) {
+    if (!current_stats && stats) stats_attached++;
+    if (current_stats && !stats) stats_attached--;
+    current_stats = stats;
+}
+
+void lagrange_stats_count_allocation(void) {
+    thread_allocations++;
+}
+
+void lagrange_stats_enable(int flags) {
+    stats_flags.store(flags & (LAGRANGE_STATS_AGGREGATE | LAGRANGE_STATS_TRACE), std::memory_order_relaxed);
+}
+
+void lagrange_stats_get(LagrangeGlobalStats* stats) {
+    if (!stats) return;
+
+    read_latency(global.calls, stats->calls);
+    for (int i = 0; i < LAGRANGE_STAGE_COUNT; i++) {
+        read_latency(global.stages[i], stats->stages[i]);
+    }
+    stats->failures = global.failures.load(std::memory_order_relaxed);
+    stats->bytesIn = global.counters[STATS_BYTES_IN].load(std::memory_order_relaxed);
+    stats->bytesOut = global.counters[STATS_BYTES_OUT].load(std::memory_order_relaxed);
+    stats->frames = global.counters[STATS_FRAMES].load(std::memory_order_relaxed);
+    stats->packets = global.counters[STATS_PACKETS].load(std::memory_order_relaxed);
+}
+
+void lagrange_stats_reset() {
+    clear_latency(global.calls);
+    for (auto& stage : global.stages) {
+        clear_latency(stage);
+    }
+    global.failures = 0;
+    for (auto& counter : global.counters) {
+        counter = 0;
+    }
+
+    std::lock_guard lock(trace_mutex);
+    trace_events.clear();
+    trace_dropped = 0;
+}
+
+int lagrange_trace_export(cb_codec callback, void* userdata) {
+    if (!callback) {
+        return 1;
+    }
+
+    std::lock_guard lock(trace_mutex);
+    std::string json = "{\"traceEvents\":[";
+    char event[256];
+    for (size_t i = 0; i < trace_events.size(); i++) {
+        const TraceEvent& e = trace_events[i];
+        // Complete events, timestamps in microseconds
+        snprintf(event, sizeof(event), "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                 i ? "," : "", e.name, e.category, e.tid, e.start_ns / 1000.0, e.duration_ns / 1000.0);
+        json += event;
+
+        if (json.size() >= 64 * 1024) { // Keep the chunks small, the trace may be large
+            callback(userdata, reinterpret_cast<const uint8_t*>(json.data()), static_cast<int>(json.size()));
+            json.clear();
+        }
+    }
+    snprintf(event, sizeof(event), "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":%lld}}",
+             static_cast<long long>(trace_dropped));
+    json += event;
+    callback(userdata, reinterpret_cast<const uint8_t*>(json.data()), static_cast<int>(json.size()));
+    return 0;
+}
@@ -0,0 +1,162 @@
+//
+// Created by Wenxuan Lin on 2026-10-16.
+//
+
+#include "thread_pool.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace {
+    thread_local const ThreadPool* current_pool = nullptr;
+    thread_local size_t current_index = 0;
+
+    std::mutex shared_mutex;
+    std::shared_ptr<ThreadPool> shared_pool;
+
+    void pin_current_thread(size_t index) {
+        const unsigned int cores = std::thread::hardware_concurrency();
+        if (cores == 0) return;
+        const size_t cpu = index % cores;
+
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+        if (cpu < sizeof(DWORD_PTR) * 8) {
+            SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu);
+        }
+#else
+        (void)cpu; // No affinity API on this platform, pinning is a hint only
+#endif
+    }
+
+    // Deleter of the shared pool. The last reference may be dropped by one of the pool's own workers
+    // (a task that held it, or one that called configure_shared), which can't join itself, so the
+    // pool is then destroyed on a thread of its own.
+    void release_shared(ThreadPool* pool) {
+        if (current_pool == pool) {
+            std::thread([pool] { delete pool; }).detach();
+            return;
+        }
+        delete pool;
+    }
+}
+
+ThreadPool::ThreadPool(int thread_count, bool pin_threads) {
+    if (thread_count <= 0) {
+        thread_count = default_thread_count();
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < thread_count; i++) {
+        threads.emplace_back(&ThreadPool::run, this, static_cast<size_t>(i), pin_threads);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+int ThreadPool::default_thread_count() {
+    const unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? static_cast<int>(cores) : 1;
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::shared() {
+    std::lock_guard lock(shared_mutex);
+    if (!shared_pool) {
+        shared_pool = std::shared_ptr<ThreadPool>(new ThreadPool(0), release_shared);
+    }
+    return shared_pool;
+}
+
+void ThreadPool::configure_shared(int thread_count, bool pin_threads) {
+    std::shared_ptr<ThreadPool> pool(new ThreadPool(thread_count, pin_threads), release_shared);
+    std::shared_ptr<ThreadPool> old_pool;
+    {
+        std::lock_guard lock(shared_mutex);
+        old_pool = std::move(shared_pool);
+        shared_pool = std::move(pool);
+    }
+    // old_pool drains outside the lock once its last user releases it, see release_shared
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    const size_t index = current_pool == this ? current_index : next++ % workers.size();
+
+    pending++; // Counted before it is visible, so a worker never sees the queue ahead of the counter
+    {
+        std::lock_guard lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(mutex);
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::try_pop(size_t index, std::function<void()>& task) {
+    {
+        auto& own = *workers[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < workers.size(); i++) {
+        auto& victim = *workers[(index + i) % workers.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run(size_t index, bool pin_thread) {
+    current_pool = this;
+    current_index = index;
+    if (pin_thread) {
+        pin_current_thread(index);
+    }
+
+    std::function<void()> task;
+    while (true) {
+        if (try_pop(index, task)) {
+            pending--;
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock lock(mutex);
+        wake.wait(lock, [this] { return stopping || pending > 0; });
+        if (stopping && pending == 0) {
+            return;
+        }
+    }
+}
@@ -6,174 +6,524 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 }
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
 #include "util.h"
 #include "video.h"
 
-int save_frame_as_png(AVFrame* frame, int width, int height, uint8_t*& out, int& out_len) {
-    auto png_codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
-    if (!png_codec) {
-        fprintf(stderr, "ERROR: AV_CODEC_ID_PNG codec not found\n");
+namespace {
+    struct ImageEncoder {
+        AVCodecID codec_id;
+        AVPixelFormat pix_fmt; // Straight out of sws, so the encoder never converts again
+    };
+
+    ImageEncoder image_encoder_of(int format) {
+        switch (format) {
+            case LAGRANGE_IMAGE_JPEG: return { AV_CODEC_ID_MJPEG, AV_PIX_FMT_YUVJ420P };
+            case LAGRANGE_IMAGE_WEBP: return { AV_CODEC_ID_WEBP, AV_PIX_FMT_YUV420P };
+            default: return { AV_CODEC_ID_PNG, AV_PIX_FMT_RGB24 };
+        }
+    }
+
+    int sws_flags_of(int scaling) {
+        switch (scaling) {
+            case LAGRANGE_SCALE_FAST_BILINEAR: return SWS_FAST_BILINEAR;
+            case LAGRANGE_SCALE_BICUBIC: return SWS_BICUBIC;
+            case LAGRANGE_SCALE_AREA: return SWS_AREA;
+            case LAGRANGE_SCALE_LANCZOS: return SWS_LANCZOS;
+            case LAGRANGE_SCALE_POINT: return SWS_POINT;
+            default: return SWS_BILINEAR;
+        }
+    }
+
+    // Fits width x height into the box keeping the aspect ratio, never upscales
+    void fit_size(int width, int height, int max_width, int max_height, int& out_width, int& out_height) {
+        out_width = width;
+        out_height = height;
+        if (max_width > 0 && out_width > max_width) {
+            out_height = static_cast<int>(av_rescale(out_height, max_width, out_width));
+            out_width = max_width;
+        }
+        if (max_height > 0 && out_height > max_height) {
+            out_width = static_cast<int>(av_rescale(out_width, max_height, out_height));
+            out_height = max_height;
+        }
+        out_width = FFMAX(out_width, 1);
+        out_height = FFMAX(out_height, 1);
+    }
+
+    const ThumbnailOptions default_thumbnail_options = { 0, 0, LAGRANGE_SCALE_BILINEAR, LAGRANGE_IMAGE_PNG, 0, nullptr, 0, 0, 0 };
+}
+
+static int encode_image(const AVFrame* frame, int format, int quality, uint8_t*& out, int& out_len) {
+    StageTimer timer(LAGRANGE_STAGE_IMAGE_ENCODE);
+    const ImageEncoder image_encoder = image_encoder_of(format);
+    const AVCodec* codec = image_encoder.codec_id == AV_CODEC_ID_WEBP
+        ? avcodec_find_encoder_by_name("libwebp") // Not the animated one, it holds the frame back
+        : avcodec_find_encoder(image_encoder.codec_id);
+    if (!codec) {
+        LOG_ERROR("image encoder for format %d not found", format);
         return -1;
     }
 
-    AVCodecContext* codec_context = avcodec_alloc_context3(png_codec);
+    AVCodecContext* codec_context = avcodec_alloc_context3(codec);
     if (!codec_context) {
-        fprintf(stderr, "ERROR: Failed to allocate codec context for AV_CODEC_ID_PNG\n");
+        LOG_ERROR("Failed to allocate codec context for the image encoder");
         return -1;
     }
 
     codec_context->bit_rate = 0;
-    codec_context->width = width;
-    codec_context->height = height;
-    codec_context->pix_fmt = AV_PIX_FMT_RGB24;  // RGB format
+    codec_context->width = frame->width;
+    codec_context->height = frame->height;
+    codec_context->pix_fmt = image_encoder.pix_fmt;
     codec_context->time_base = AVRational{1, 25}; // Assume 25 fps for example
 
-    if (avcodec_open2(codec_context, png_codec, nullptr) < 0) {
-        fprintf(stderr, "ERROR: Failed to open codec\n");
+    quality = FFMIN(quality, 100);
+    if (quality > 0) {
+        switch (image_encoder.codec_id) {
+            case AV_CODEC_ID_MJPEG: // Quality 100 is qscale 2, quality 1 is qscale 31
+                codec_context->flags |= AV_CODEC_FLAG_QSCALE;
+                codec_context->global_quality = FF_QP2LAMBDA * (2 + (100 - quality) * 29 / 99);
+                break;
+            case AV_CODEC_ID_WEBP:
+                av_opt_set_double(codec_context, "quality", quality, AV_OPT_SEARCH_CHILDREN);
+                break;
+            default: // PNG is lossless, the quality only picks the zlib level and with it the speed
+                codec_context->compression_level = (quality + 10) / 11;
+                break;
+        }
+    }
+
+    if (avcodec_open2(codec_context, codec, nullptr) < 0) {
+        LOG_ERROR("Failed to open codec");
         avcodec_free_context(&codec_context);
         return -1;
     }
 
-    AVPacket pkt;
-    av_init_packet(&pkt);
-
-    int ret = avcodec_send_frame(codec_context, frame);
-    if (ret < 0) {
-        fprintf(stderr, "ERROR: Failed to send frame to encoder\n");
+    AVFrame* input = av_frame_alloc();
+    AVPacket* pkt = av_packet_alloc();
+    if (!input || !pkt || av_frame_ref(input, frame) < 0) {
+        LOG_ERROR("Failed to allocate the encoder input");
+        av_frame_free(&input);
+        av_packet_free(&pkt);
         avcodec_free_context(&codec_context);
         return -1;
     }
+    input->quality = codec_context->global_quality;
 
-    ret = avcodec_receive_packet(codec_context, &pkt); // Receive the encoded PNG packet
+    int ret = avcodec_send_frame(codec_context, input);
+    if (ret >= 0) {
+        ret = avcodec_send_frame(codec_context, nullptr); // Single image, flush it out right away
+    }
     if (ret < 0) {
-        fprintf(stderr, "ERROR: Failed to receive packet\n");
-        avcodec_free_context(&codec_context);
-        return -1;
+        LOG_ERROR("Failed to send frame to encoder");
+    } else {
+        ret = avcodec_receive_packet(codec_context, pkt); // Receive the encoded image
+        if (ret < 0) {
+            LOG_ERROR("Failed to receive packet");
+        }
     }
 
-    out_len = pkt.size;
-    out = static_cast<uint8_t*>(av_malloc(out_len));
-    memcpy(out, pkt.data, out_len);
+    if (ret >= 0) {
+        out_len = pkt->size;
+        out = static_cast<uint8_t*>(av_malloc(out_len));
+        memcpy(out, pkt->data, out_len);
+    }
 
-    av_packet_unref(&pkt);
+    av_packet_free(&pkt);
+    av_frame_free(&input);
     avcodec_free_context(&codec_context);
 
+    return ret < 0 ? -1 : 0;
+}
+
+// Scales frame into dst, sws_context is created or updated to match and kept for the next call
+static int scale_frame(SwsContext*& sws_context, const AVFrame* frame, int scaling,
+                       int width, int height, AVPixelFormat pix_fmt, uint8_t* const dst[], const int dst_linesize[]) {
+    sws_context = sws_getCachedContext(sws_context,
+        frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+        width, height, pix_fmt,
+        sws_flags_of(scaling), nullptr, nullptr, nullptr);
+    if (!sws_context) {
+        LOG_ERROR("failed to create the scaler");
+        return -1;
+    }
+
+    StageTimer timer(LAGRANGE_STAGE_SCALE);
+    sws_scale(sws_context, frame->data, frame->linesize, 0, frame->height, dst, dst_linesize);
     return 0;
 }
 
-int video_first_frame(uint8_t* video_data, int data_len, uint8_t*& out, int& out_len) {
-    AVFormatContext* format_context = nullptr;
+// Scales straight to the thumbnail size and the pixel format of the image encoder, then encodes
+static int save_thumbnail(SwsContext*& sws_context, const AVFrame* frame, const ThumbnailOptions& options,
+                          uint8_t*& out, int& out_len) {
+    int width, height;
+    fit_size(frame->width, frame->height, options.maxWidth, options.maxHeight, width, height);
+    const AVPixelFormat pix_fmt = image_encoder_of(options.format).pix_fmt;
 
-    int ret_code = create_format_context(video_data, data_len, &format_context);
-    if (ret_code < 0) {
-        fprintf(stderr, "ERROR: failed to create format context\n");
-        return -1;
+    AVFrame* scaled_frame = av_frame_alloc();
+    scaled_frame->width = width;
+    scaled_frame->height = height;
+    scaled_frame->format = pix_fmt;
+
+    int ret = av_frame_get_buffer(scaled_frame, 0);
+    if (ret < 0) {
+        LOG_ERROR("failed to allocate the scaled frame");
+    } else {
+        ret = scale_frame(sws_context, frame, options.scaling, width, height, pix_fmt, scaled_frame->data, scaled_frame->linesize);
+        if (ret >= 0) {
+            ret = encode_image(scaled_frame, options.format, options.quality, out, out_len);
+        }
     }
 
-    ret_code = avformat_open_input(&format_context, nullptr, nullptr, nullptr);
-    if (ret_code < 0) {
-        fprintf(stderr, "ERROR: failed to open the media stream\n");
-        return -1;
+    av_frame_free(&scaled_frame);
+
+    return ret < 0 ? -1 : 0;
+}
+
+namespace {
+    // Decoder threads of all calls together, 0 means std::thread::hardware_concurrency
+    std::atomic<int> thread_budget { 0 };
+    std::atomic<int> threads_in_use { 0 };
+
+    // Single frame extraction gains little from more threads than this, frame threading only adds delay
+    constexpr int DEFAULT_DECODE_THREADS = 4;
+
+    // Takes up to wanted threads from the budget, always at least the caller's own
+    int acquire_threads(int wanted) {
+        int budget = thread_budget.load();
+        if (budget <= 0) budget = FFMAX(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+        int in_use = threads_in_use.load();
+        int granted;
+        do {
+            granted = FFMAX(FFMIN(wanted, budget - in_use), 1);
+        } while (!threads_in_use.compare_exchange_weak(in_use, in_use + granted));
+        return granted;
     }
 
-    if (avformat_find_stream_info(format_context, nullptr) < 0) {
-        fprintf(stderr, "ERROR: failed to find stream info\n");
+    // One open demuxer and decoder, kept across seeks
+    struct VideoDecoder {
+        AVFormatContext* format_context = nullptr;
+        AVCodecContext* codec_context = nullptr;
+        AVPacket* packet = nullptr;
+        int stream_index = -1;
+        int threads = 0; // Taken from the budget, returned on close
+        bool draining = false;
+    };
+}
+
+void video_set_thread_budget(int threads) {
+    thread_budget = FFMAX(threads, 0);
+}
+
+static void close_video_decoder(VideoDecoder& decoder) {
+    av_packet_free(&decoder.packet);
+    avcodec_free_context(&decoder.codec_context);
+    free_format_context(&decoder.format_context);
+    threads_in_use -= decoder.threads;
+    decoder.threads = 0;
+}
+
+// Decoder shortcuts for thumbnails, the quality loss doesn't show at thumbnail size
+static void apply_fast_decode(AVCodecContext* codec_context, const AVCodec* codec, const ThumbnailOptions& options) {
+    // Halve the decoded size as often as the codec allows while it still covers the thumbnail box
+    int lowres = 0;
+    if (options.maxWidth > 0 || options.maxHeight > 0) {
+        while (lowres < codec->max_lowres) {
+            const int width = codec_context->width >> (lowres + 1);
+            const int height = codec_context->height >> (lowres + 1);
+            if (width < options.maxWidth || height < options.maxHeight) break; // An unbounded side is 0
+            lowres++;
+        }
+    }
+
+    codec_context->lowres = lowres;
+    codec_context->skip_loop_filter = AVDISCARD_ALL;
+    codec_context->skip_idct = AVDISCARD_NONREF;
+    codec_context->flags2 |= AV_CODEC_FLAG2_FAST;
+}
+
+// Opens the best video stream of a context from create_format_context, everything is released if this fails
+static int open_video_decoder(AVFormatContext* format_context, const ThumbnailOptions& options,
+                              AVDiscard skip_frame, VideoDecoder& decoder) {
+    if (open_input(&format_context, options.probe, AVMEDIA_TYPE_VIDEO) < 0) {
         return -1;
     }
+    decoder.format_context = format_context;
 
-    const AVCodec *codec = nullptr;
-    int video_stream_index = -1;
-    for (unsigned int i = 0; i < format_context->nb_streams; i++) {
-        if (format_context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
-            codec = avcodec_find_decoder(format_context->streams[i]->codecpar->codec_id);
-            break;
-        }
+    const AVCodec* codec = nullptr;
+    decoder.stream_index = av_find_best_stream(format_context, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (decoder.stream_index < 0 || !codec) {
+        LOG_ERROR("no video stream found");
+        close_video_decoder(decoder);
+        return -1;
     }
 
-    if (video_stream_index == -1) {
-        fprintf(stderr, "ERROR: no video stream found\n");
+    decoder.codec_context = avcodec_alloc_context3(codec);
+    decoder.packet = av_packet_alloc();
+    if (!decoder.codec_context || !decoder.packet) {
+        LOG_ERROR("failed to allocate the decoder");
+        close_video_decoder(decoder);
         return -1;
     }
 
-    AVCodecContext* codec_context = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(codec_context, format_context->streams[video_stream_index]->codecpar);
+    const AVStream* stream = format_context->streams[decoder.stream_index];
+    avcodec_parameters_to_context(decoder.codec_context, stream->codecpar);
+    decoder.codec_context->pkt_timebase = stream->time_base;
+    decoder.codec_context->skip_frame = skip_frame;
 
-    if (avcodec_open2(codec_context, codec, nullptr) < 0) {
-        fprintf(stderr, "ERROR: failed to open the codec\n");
+    if (options.fastDecode) {
+        apply_fast_decode(decoder.codec_context, codec, options);
+    }
+
+    decoder.threads = acquire_threads(options.threadCount > 0 ? options.threadCount : DEFAULT_DECODE_THREADS);
+    decoder.codec_context->thread_count = decoder.threads;
+    decoder.codec_context->thread_type = options.threadType > 0 ? options.threadType : FF_THREAD_SLICE;
+
+    if (avcodec_open2(decoder.codec_context, codec, nullptr) < 0) {
+        LOG_ERROR("failed to open the codec");
+        close_video_decoder(decoder);
         return -1;
     }
 
-    AVFrame* frame = av_frame_alloc();
-    AVPacket packet;
+    return 0;
+}
 
-    while (av_read_frame(format_context, &packet) >= 0) {
-        if (packet.stream_index == video_stream_index) {
-            int response = avcodec_send_packet(codec_context, &packet);
-            if (response < 0) {
-                fprintf(stderr, "ERROR: failed to send packet\n");
-                return -1;
+// Returns 0 with the next frame, AVERROR_EOF once the decoder is drained or another error
+static int decode_next_frame(VideoDecoder& decoder, AVFrame* frame) {
+    while (true) {
+        int ret;
+        {
+            StageTimer timer(LAGRANGE_STAGE_DECODE);
+            ret = avcodec_receive_frame(decoder.codec_context, frame);
+        }
+        if (ret == 0) stats_count(STATS_FRAMES, 1);
+        if (ret != AVERROR(EAGAIN)) return ret; // A frame, the end or an error
+
+        // The decoder wants input, so sending can't be refused with EAGAIN
+        ret = read_packet(decoder.format_context, decoder.packet);
+        if (ret < 0) {
+            if (decoder.draining) return AVERROR_EOF;
+            decoder.draining = true;
+            avcodec_send_packet(decoder.codec_context, nullptr); // Flush the frames held back by the decoder
+            continue;
+        }
+
+        if (decoder.packet->stream_index == decoder.stream_index) {
+            StageTimer timer(LAGRANGE_STAGE_DECODE);
+            ret = avcodec_send_packet(decoder.codec_context, decoder.packet);
+            if (ret < 0 && ret != AVERROR_INVALIDDATA) { // A damaged packet is skipped
+                av_packet_unref(decoder.packet);
+                return ret;
             }
+        }
+        av_packet_unref(decoder.packet);
+    }
+}
+
+// Moves to the keyframe at or before timestamp_ms, false if the input can't seek
+static bool seek_video(VideoDecoder& decoder, int64_t timestamp_ms) {
+    const AVStream* stream = decoder.format_context->streams[decoder.stream_index];
+    int64_t target = av_rescale_q(timestamp_ms, { 1, 1000 }, stream->time_base);
+    if (stream->start_time != AV_NOPTS_VALUE) {
+        target += stream->start_time;
+    }
+
+    if (av_seek_frame(decoder.format_context, decoder.stream_index, target, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+    avcodec_flush_buffers(decoder.codec_context);
+    decoder.draining = false;
+    return true;
+}
 
-            response = avcodec_receive_frame(codec_context, frame);
-            if (response == 0) { // Frame successfully decoded
+static int64_t frame_time_ms(const VideoDecoder& decoder, const AVFrame* frame) {
+    const AVStream* stream = decoder.format_context->streams[decoder.stream_index];
+    if (frame->best_effort_timestamp == AV_NOPTS_VALUE) return -1;
+
+    int64_t timestamp = frame->best_effort_timestamp;
+    if (stream->start_time != AV_NOPTS_VALUE) {
+        timestamp -= stream->start_time;
+    }
+    return av_rescale_q(timestamp, stream->time_base, { 1, 1000 });
+}
+
+static int64_t video_duration_ms(const VideoDecoder& decoder) {
+    const AVFormatContext* format_context = decoder.format_context;
+    if (format_context->duration != AV_NOPTS_VALUE) {
+        return format_context->duration / 1000;
+    }
+
+    const AVStream* stream = format_context->streams[decoder.stream_index];
+    return stream->duration == AV_NOPTS_VALUE ? 0 : av_rescale_q(stream->duration, stream->time_base, { 1, 1000 });
+}
+
+// Points dst at the top left pixel of the tile at x, y of an image in pix_fmt
+static void tile_planes(const AVFrame* sheet, int x, int y, uint8_t* dst[4]) {
+    const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(sheet->format));
+    int steps[4];
+    av_image_fill_max_pixsteps(steps, nullptr, descriptor);
+
+    for (int i = 0; i < 4; i++) {
+        const bool chroma = i == 1 || i == 2;
+        const int plane_x = chroma ? x >> descriptor->log2_chroma_w : x;
+        const int plane_y = chroma ? y >> descriptor->log2_chroma_h : y;
+        dst[i] = sheet->data[i] ? sheet->data[i] + plane_y * sheet->linesize[i] + plane_x * steps[i] : nullptr;
+    }
+}
+
+// Decodes the keyframe at or before every timestamp with a single demuxer, decoder and scaler,
+// and hands out one image per timestamp or a single sprite sheet
+static int extract_frames(AVFormatContext* format_context, const VideoFramesOptions& options,
+                          cb_codec callback, void* userdata) {
+    CallScope scope("video_frames");
+    scope.wrap_output(callback, userdata);
+    const ThumbnailOptions& thumbnail = options.thumbnail;
+    if (options.count <= 0) {
+        free_format_context(&format_context);
+        return scope.result(-1);
+    }
+
+    VideoDecoder decoder;
+    if (open_video_decoder(format_context, thumbnail, AVDISCARD_NONKEY, decoder) < 0) {
+        return scope.result(-1);
+    }
+
+    std::vector<int64_t> timestamps(options.count);
+    const int64_t duration = video_duration_ms(decoder);
+    for (int i = 0; i < options.count; i++) {
+        timestamps[i] = options.timestampsMs ? options.timestampsMs[i] : duration * i / options.count;
+    }
+
+    const AVPixelFormat pix_fmt = image_encoder_of(thumbnail.format).pix_fmt;
+    const int columns = FFMIN(options.spriteColumns, options.count);
+    AVFrame* frame = av_frame_alloc();
+    AVFrame* held = av_frame_alloc(); // Last keyframe, reused when the input ends before a timestamp
+    AVFrame* sheet = nullptr;
+    SwsContext* sws_context = nullptr;
+    bool has_held = false;
+    int ret = frame && held ? 0 : -1;
+
+    for (int i = 0; i < options.count && ret >= 0; i++) {
+        // Without seeking, keep reading forward until the keyframe reaches the timestamp
+        const bool seeked = seek_video(decoder, timestamps[i]);
+        while (true) {
+            const int response = decode_next_frame(decoder, frame);
+            if (response == AVERROR_EOF) break;
+            if (response < 0) {
+                LOG_ERROR("failed to decode the video");
+                ret = -1;
                 break;
             }
+
+            av_frame_unref(held);
+            av_frame_move_ref(held, frame);
+            has_held = true;
+            const int64_t time = frame_time_ms(decoder, held);
+            if (seeked || time < 0 || time >= timestamps[i]) break;
+        }
+        if (ret < 0) break;
+        if (!has_held) {
+            LOG_ERROR("no video frame decoded");
+            ret = -1;
+            break;
         }
-        av_packet_unref(&packet);
-    }
 
-    // Save the frame as an image
-    SwsContext* sws_context = sws_getContext(
-        frame->width, frame->height, codec_context->pix_fmt,
-        frame->width, frame->height, AV_PIX_FMT_RGB24,
-        SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (columns <= 0) {
+            uint8_t* image = nullptr;
+            int image_len = 0;
+            ret = save_thumbnail(sws_context, held, thumbnail, image, image_len);
+            if (ret >= 0) {
+                callback(userdata, image, image_len);
+                av_free(image);
+            }
+            continue;
+        }
 
-    AVFrame* rgb_frame = av_frame_alloc();
-    rgb_frame->width = frame->width;
-    rgb_frame->height = frame->height;
-    rgb_frame->format = AV_PIX_FMT_RGB24;
+        // Every tile takes the size of the first frame, even so the chroma planes line up
+        int width, height;
+        fit_size(held->width, held->height, thumbnail.maxWidth, thumbnail.maxHeight, width, height);
+        if (!sheet) {
+            sheet = av_frame_alloc();
+            sheet->format = pix_fmt;
+            sheet->width = FFMAX(width & ~1, 2) * columns;
+            sheet->height = FFMAX(height & ~1, 2) * ((options.count + columns - 1) / columns);
+            if (av_frame_get_buffer(sheet, 0) < 0) {
+                LOG_ERROR("failed to allocate the sprite sheet");
+                ret = -1;
+                break;
+            }
+            const std::ptrdiff_t linesizes[4] = { sheet->linesize[0], sheet->linesize[1], sheet->linesize[2], sheet->linesize[3] };
+            const AVColorRange range = pix_fmt == AV_PIX_FMT_YUV420P ? AVCOL_RANGE_MPEG : AVCOL_RANGE_JPEG;
+            av_image_fill_black(sheet->data, linesizes, pix_fmt, range, sheet->width, sheet->height);
+        }
 
-    int num_bytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, frame->width, frame->height, 1);
-    auto buffer = static_cast<uint8_t *>(av_malloc(num_bytes * sizeof(uint8_t)));
-    av_image_fill_arrays(rgb_frame->data, rgb_frame->linesize, buffer, AV_PIX_FMT_RGB24, frame->width, frame->height, 1);
+        const int tile_width = sheet->width / columns;
+        const int tile_height = sheet->height / ((options.count + columns - 1) / columns);
+        uint8_t* planes[4];
+        tile_planes(sheet, i % columns * tile_width, i / columns * tile_height, planes);
+        ret = scale_frame(sws_context, held, thumbnail.scaling, tile_width, tile_height, pix_fmt, planes, sheet->linesize);
+    }
 
-    sws_scale(sws_context, frame->data, frame->linesize, 0, frame->height, rgb_frame->data, rgb_frame->linesize);
-    save_frame_as_png(rgb_frame, rgb_frame->width, rgb_frame->height, out, out_len);
+    if (ret >= 0 && sheet) {
+        uint8_t* image = nullptr;
+        int image_len = 0;
+        ret = encode_image(sheet, thumbnail.format, thumbnail.quality, image, image_len);
+        if (ret >= 0) {
+            callback(userdata, image, image_len);
+            av_free(image);
+        }
+    }
 
-    av_free(format_context->pb->buffer);
-    av_free(buffer);
-    av_frame_free(&rgb_frame);
-    sws_freeContext(sws_context);
+    av_frame_free(&sheet);
+    av_frame_free(&held);
     av_frame_free(&frame);
-    avcodec_free_context(&codec_context);
-    avformat_close_input(&format_context);
+    sws_freeContext(sws_context);
+    close_video_decoder(decoder);
 
-    return 0;
+    return scope.result(ret < 0 ? -1 : 0);
 }
 
-int video_get_size(uint8_t* video_data, int data_len, VideoInfo& info) {
-    AVFormatContext* format_context = nullptr;
-
-    int ret_code = create_format_context(video_data, data_len, &format_context);
-    if (ret_code < 0) {
-        av_free(format_context->pb->buffer);
-        return -1;
+// Extracts the first frame of a context from create_format_context, the context is always released
+static int first_frame(AVFormatContext* format_context, const ThumbnailOptions& options, uint8_t*& out, int& out_len) {
+    CallScope scope("video_thumbnail");
+    VideoDecoder decoder;
+    if (open_video_decoder(format_context, options, AVDISCARD_DEFAULT, decoder) < 0) {
+        return scope.result(-1);
     }
 
-    ret_code = avformat_open_input(&format_context, nullptr, nullptr, nullptr);
-    if (ret_code < 0) {
-        av_free(format_context->pb->buffer);
-        return -1;
+    AVFrame* frame = av_frame_alloc();
+    int ret = frame ? decode_next_frame(decoder, frame) : -1;
+    if (ret >= 0) {
+        SwsContext* sws_context = nullptr;
+        ret = save_thumbnail(sws_context, frame, options, out, out_len);
+        sws_freeContext(sws_context);
+    } else {
+        LOG_ERROR("no video frame decoded");
     }
 
-    if (avformat_find_stream_info(format_context, nullptr) < 0) {
-        av_free(format_context->pb->buffer);
-        avformat_close_input(&format_context);
-        return {};
+    av_frame_free(&frame);
+    close_video_decoder(decoder);
+
+    if (ret >= 0) scope.add_output(out_len);
+    return scope.result(ret < 0 ? -1 : 0);
+}
+
+// Reads the video size of a context from create_format_context, the context is always released
+// With skipStreamInfo set this only reads the container header
+static int get_size(AVFormatContext* format_context, const LagrangeProbeOptions* probe, VideoInfo& info) {
+    CallScope scope("video_get_size");
+    if (open_input(&format_context, probe, AVMEDIA_TYPE_VIDEO) < 0) {
+        return scope.result(-1); // Probing may have been interrupted by the call's limits
     }
 
     AVCodecParameters* codec_parameters = nullptr;
@@ -187,14 +537,157 @@ int video_get_size(uint8_t* video_data, int data_len, VideoInfo& info) {
     }
 
     if (index == -1) {
-        av_free(format_context->pb->buffer);
-        avformat_close_input(&format_context);
+        free_format_context(&format_context);
+        return scope.result(-1);
+    }
+
+    int64_t duration = format_context->duration / AV_TIME_BASE;
+    if (format_context->duration == AV_NOPTS_VALUE) { // Not summed up without avformat_find_stream_info
+        const AVStream* stream = format_context->streams[index];
+        // av_rescale_q rounds to the nearest, go through AV_TIME_BASE to truncate like the container duration
+        duration = stream->duration == AV_NOPTS_VALUE ? 0
+                 : av_rescale_q(stream->duration, stream->time_base, { 1, AV_TIME_BASE }) / AV_TIME_BASE;
+    }
+    info = { codec_parameters->width, codec_parameters->height, duration };
+
+    free_format_context(&format_context);
+    return scope.result(0);
+}
+
+int video_first_frame(uint8_t* video_data, int data_len, uint8_t*& out, int& out_len) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(video_data, data_len, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
         return -1;
     }
 
-    info = { codec_parameters->width, codec_parameters->height, (format_context->duration / AV_TIME_BASE) };
+    return first_frame(format_context, default_thumbnail_options, out, out_len);
+}
 
-    av_free(format_context->pb->buffer);
-    avformat_close_input(&format_context);
-    return 0;
-}
\ No newline at end of file
+int video_first_frame_io(const LagrangeIoSource* source, uint8_t*& out, int& out_len) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(source, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return -1;
+    }
+
+    return first_frame(format_context, default_thumbnail_options, out, out_len);
+}
+
+int video_get_size(uint8_t* video_data, int data_len, VideoInfo& info) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(video_data, data_len, &format_context) < 0) {
+        return -1;
+    }
+
+    return get_size(format_context, nullptr, info);
+}
+
+int video_get_size_io(const LagrangeIoSource* source, VideoInfo& info) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(source, &format_context) < 0) {
+        return -1;
+    }
+
+    return get_size(format_context, nullptr, info);
+}
+
+int video_first_frame_ex(uint8_t* video_data, int data_len, const LagrangeProbeOptions* probe,
+                         uint8_t*& out, int& out_len) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(video_data, data_len, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return -1;
+    }
+
+    ThumbnailOptions options = default_thumbnail_options;
+    options.probe = probe;
+    return first_frame(format_context, options, out, out_len);
+}
+
+int video_get_size_ex(uint8_t* video_data, int data_len, const LagrangeProbeOptions* probe, VideoInfo& info) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(video_data, data_len, &format_context) < 0) {
+        return -1;
+    }
+
+    return get_size(format_context, probe, info);
+}
+
+int video_thumbnail(uint8_t* video_data, int data_len, const ThumbnailOptions* options, uint8_t*& out, int& out_len) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(video_data, data_len, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return -1;
+    }
+
+    return first_frame(format_context, options ? *options : default_thumbnail_options, out, out_len);
+}
+
+int video_thumbnail_io(const LagrangeIoSource* source, const ThumbnailOptions* options, uint8_t*& out, int& out_len) {
+    AVFormatContext* format_context = nullptr;
+    if (create_format_context(source, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return -1;
+    }
+
+    return first_frame(format_context, options ? *options : default_thumbnail_options, out, out_len);
+}
+
+int video_frames(uint8_t* video_data, int data_len, const VideoFramesOptions* options, cb_codec callback, void* userdata) {
+    AVFormatContext* format_context = nullptr;
+    if (!options || create_format_context(video_data, data_len, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return -1;
+    }
+
+    return extract_frames(format_context, *options, callback, userdata);
+}
+
+int video_frames_io(const LagrangeIoSource* source, const VideoFramesOptions* options, cb_codec callback, void* userdata) {
+    AVFormatContext* format_context = nullptr;
+    if (!options || create_format_context(source, &format_context) < 0) {
+        LOG_ERROR("failed to create format context");
+        return -1;
+    }
+
+    return extract_frames(format_context, *options, callback, userdata);
+}
+
+// Containers such as mp4 may keep their index at the end, so the mappings below are not sequential
+
+int video_first_frame_file(const char* path, uint8_t*& out, int& out_len) {
+    MappedFile file;
+    if (!map_input(file, path, false)) {
+        return -1;
+    }
+
+    return video_first_frame(file.data(), static_cast<int>(file.size()), out, out_len);
+}
+
+int video_get_size_file(const char* path, VideoInfo& info) {
+    MappedFile file;
+    if (!map_input(file, path, false)) {
+        return -1;
+    }
+
+    return video_get_size(file.data(), static_cast<int>(file.size()), info);
+}
+
+int video_thumbnail_file(const char* path, const ThumbnailOptions* options, uint8_t*& out, int& out_len) {
+    MappedFile file;
+    if (!map_input(file, path, false)) {
+        return -1;
+    }
+
+    return video_thumbnail(file.data(), static_cast<int>(file.size()), options, out, out_len);
+}
+
+int video_frames_file(const char* path, const VideoFramesOptions* options, cb_codec callback, void* userdata) {
+    MappedFile file;
+    if (!map_input(file, path, false)) {
+        return -1;
+    }
+
+    return video_frames(file.data(), static_cast<int>(file.size()), options, callback, userdata);
+}
@@ -10,9 +10,22 @@
 #include <fstream>
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <condition_variable>
+#include <coroutine>
+#include <future>
+#include <mutex>
+#include <thread>
 
 #include "audio.h"
+#include "awaitable.h"
+#include "batch.h"
+#include "cancel.h"
+#include "log.h"
 #include "silk.h"
+#include "stats.h"
 #include "video.h"
 
 #ifndef LAGRANGECODEC_TEST_DATA_DIR
@@ -26,6 +39,34 @@ void testCallback(void* userdata, const uint8_t* data, int len) {
     }
 }
 
+struct TestIoSource {
+    const std::vector<uint8_t>* data;
+    int64_t pos;
+
+    static int read(void* userdata, uint8_t* buf, int buf_size) {
+        auto self = static_cast<TestIoSource *>(userdata);
+        const int64_t n = std::min<int64_t>(buf_size, static_cast<int64_t>(self->data->size()) - self->pos);
+        memcpy(buf, self->data->data() + self->pos, n);
+        self->pos += n;
+        return static_cast<int>(n);
+    }
+
+    static int64_t seek(void* userdata, int64_t offset, int whence) {
+        auto self = static_cast<TestIoSource *>(userdata);
+        const int64_t base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? self->pos : static_cast<int64_t>(self->data->size());
+        if (base + offset < 0 || base + offset > static_cast<int64_t>(self->data->size())) return -1;
+        return self->pos = base + offset;
+    }
+
+    static int64_t size(void* userdata) {
+        return static_cast<int64_t>(static_cast<TestIoSource *>(userdata)->data->size());
+    }
+
+    explicit TestIoSource(const std::vector<uint8_t>& data) : data(&data), pos(0) {}
+
+    LagrangeIoSource source() { return { read, seek, size, this }; }
+};
+
 class LagrangeCodecTest : public testing::Test {
 protected:
     std::vector<uint8_t> audioData;
@@ -181,6 +222,1017 @@ TEST_F(LagrangeAudioCodecTest, TestPcmToSilkOnly) {
     std::cout << "SILK encoded data size: " << localSilkData.size() << " bytes" << std::endl;
 }
 
+TEST_F(LagrangeAudioCodecTest, TestSilkEncoderChunked) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    std::vector<uint8_t> localPcmData;
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &localPcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+
+    std::vector<uint8_t> oneShotSilkData;
+    result = silk_encode(localPcmData.data(), static_cast<int>(localPcmData.size()), testCallback, &oneShotSilkData);
+    ASSERT_EQ(result, 0) << "silk_encode function failed";
+
+    // Odd chunk sizes split both samples and frames
+    std::vector<uint8_t> chunkedSilkData;
+    SilkEncoder* encoder = silk_encoder_create(testCallback, &chunkedSilkData);
+    ASSERT_TRUE(encoder != nullptr) << "silk_encoder_create function failed";
+    const int chunkSizes[] = { 1, 7, 333, 960, 4097 };
+    size_t offset = 0;
+    for (int i = 0; offset < localPcmData.size(); i++) {
+        const int chunk = static_cast<int>(std::min<size_t>(chunkSizes[i % 5], localPcmData.size() - offset));
+        ASSERT_EQ(silk_encoder_push(encoder, localPcmData.data() + offset, chunk), 0) << "silk_encoder_push failed";
+        offset += chunk;
+    }
+    EXPECT_EQ(silk_encoder_flush(encoder), 0) << "silk_encoder_flush failed";
+    silk_encoder_destroy(encoder);
+
+    EXPECT_EQ(chunkedSilkData, oneShotSilkData) << "Chunked encoding differs from silk_encode";
+}
+
+TEST_F(LagrangeAudioCodecTest, TestSilkDecoderChunked) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Failed to prepare SILK data";
+
+    result = silk_decode(silkData.data(), static_cast<int>(silkData.size()), testCallback, &decodedPcmData);
+    ASSERT_EQ(result, 0) << "silk_decode function failed";
+    // Every 20 ms frame (480 samples at 24 kHz) is decoded exactly once
+    EXPECT_EQ(decodedPcmData.size(), (pcmData.size() + 959) / 960 * 960) << "Decoded PCM length is not expected";
+
+    std::vector<uint8_t> chunkedPcmData;
+    SilkDecoder* decoder = silk_decoder_create(testCallback, &chunkedPcmData);
+    ASSERT_TRUE(decoder != nullptr) << "silk_decoder_create function failed";
+    const int chunkSizes[] = { 1, 3, 11, 64, 1500 };
+    size_t offset = 0;
+    for (int i = 0; offset < silkData.size(); i++) {
+        const int chunk = static_cast<int>(std::min<size_t>(chunkSizes[i % 5], silkData.size() - offset));
+        ASSERT_EQ(silk_decoder_push(decoder, silkData.data() + offset, chunk), 0) << "silk_decoder_push failed";
+        offset += chunk;
+    }
+    EXPECT_EQ(silk_decoder_flush(decoder), 0) << "silk_decoder_flush failed";
+    silk_decoder_destroy(decoder);
+
+    EXPECT_EQ(chunkedPcmData, decodedPcmData) << "Chunked decoding differs from silk_decode";
+
+    // Input that ends before the header is complete is not a SILK stream
+    std::vector<uint8_t> shortOutput;
+    EXPECT_NE(silk_decode(silkData.data(), 0, testCallback, &shortOutput), 0) << "Empty input was accepted";
+    EXPECT_NE(silk_decode(silkData.data(), 5, testCallback, &shortOutput), 0) << "A partial header was accepted";
+    EXPECT_TRUE(shortOutput.empty());
+}
+
+TEST_F(LagrangeAudioCodecTest, TestIoSourceEntryPoints) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "audio_to_pcm function failed";
+
+    TestIoSource audioSource(audioData);
+    LagrangeIoSource source = audioSource.source();
+    std::vector<uint8_t> ioPcmData;
+    result = audio_to_pcm_io(&source, testCallback, &ioPcmData);
+    EXPECT_EQ(result, 0) << "audio_to_pcm_io function failed";
+    EXPECT_EQ(ioPcmData, pcmData) << "audio_to_pcm_io output differs from audio_to_pcm";
+
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Failed to prepare SILK data";
+    result = silk_decode(silkData.data(), static_cast<int>(silkData.size()), testCallback, &decodedPcmData);
+    ASSERT_EQ(result, 0) << "silk_decode function failed";
+
+    TestIoSource silkSource(silkData);
+    source = silkSource.source();
+    source.seek = nullptr;
+    source.size = nullptr;
+    std::vector<uint8_t> ioDecodedPcmData;
+    result = silk_decode_io(&source, testCallback, &ioDecodedPcmData);
+    EXPECT_EQ(result, 0) << "silk_decode_io function failed";
+    EXPECT_EQ(ioDecodedPcmData, decodedPcmData) << "silk_decode_io output differs from silk_decode";
+
+    ASSERT_TRUE(hasVideoData) << "Video test data not available";
+    TestIoSource videoSource(videoData);
+    source = videoSource.source();
+    VideoInfo info = {};
+    result = video_get_size_io(&source, info);
+    EXPECT_EQ(result, 0) << "video_get_size_io function failed";
+    EXPECT_EQ(info.width, 320) << "Video width is not expected";
+    EXPECT_EQ(info.height, 240) << "Video height is not expected";
+}
+
+TEST_F(LagrangeAudioCodecTest, TestAudioToSilk) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Failed to prepare SILK data";
+
+    std::vector<uint8_t> fusedSilkData;
+    result = audio_to_silk(audioData.data(), static_cast<int>(audioData.size()), nullptr, testCallback, &fusedSilkData);
+    EXPECT_EQ(result, 0) << "audio_to_silk function failed";
+    EXPECT_EQ(fusedSilkData, silkData) << "audio_to_silk output differs from audio_to_pcm + silk_encode";
+
+    // A tiny ring forces the decode thread to block on the encoder
+    AudioToSilkOptions options = { 1, 1000 };
+    std::vector<uint8_t> pipelinedSilkData;
+    result = audio_to_silk(audioData.data(), static_cast<int>(audioData.size()), &options, testCallback, &pipelinedSilkData);
+    EXPECT_EQ(result, 0) << "Pipelined audio_to_silk failed";
+    EXPECT_EQ(pipelinedSilkData, silkData) << "Pipelined audio_to_silk output differs";
+
+    // An input that can't be opened must not produce the SILK header
+    std::vector<uint8_t> garbage(256, 0x5a), badOutput;
+    EXPECT_EQ(audio_to_silk(garbage.data(), static_cast<int>(garbage.size()), nullptr, testCallback, &badOutput), -1);
+    EXPECT_TRUE(badOutput.empty()) << "Output was written for an input that failed to open";
+}
+
+TEST_F(LagrangeAudioCodecTest, TestBatchRun) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Failed to prepare SILK data";
+
+    const LagrangePoolOptions poolOptions = { 3, 0 };
+    ASSERT_EQ(lagrange_pool_configure(&poolOptions), 0) << "lagrange_pool_configure failed";
+
+    constexpr int jobCount = 8;
+    std::vector<std::vector<uint8_t>> outputs(jobCount);
+    std::vector<LagrangeJob> jobs;
+    for (int i = 0; i < jobCount; i++) {
+        if (i % 2 == 0) {
+            jobs.push_back({ LAGRANGE_JOB_SILK_ENCODE, pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &outputs[i], -1 });
+        } else {
+            jobs.push_back({ LAGRANGE_JOB_AUDIO_TO_PCM, audioData.data(), static_cast<int>(audioData.size()), testCallback, &outputs[i], -1 });
+        }
+    }
+    // A job with a bad input must only fail itself
+    std::vector<uint8_t> badOutput;
+    uint8_t garbage[16] = { };
+    jobs.push_back({ LAGRANGE_JOB_SILK_DECODE, garbage, sizeof(garbage), testCallback, &badOutput, -1 });
+
+    EXPECT_EQ(lagrange_batch_run(jobs.data(), static_cast<int>(jobs.size())), 1) << "Unexpected number of failed jobs";
+    for (int i = 0; i < jobCount; i++) {
+        EXPECT_EQ(jobs[i].status, 0) << "Job " << i << " failed";
+        EXPECT_EQ(outputs[i], i % 2 == 0 ? silkData : pcmData) << "Job " << i << " output differs";
+    }
+    EXPECT_NE(jobs[jobCount].status, 0) << "Decoding garbage should fail";
+}
+
+TEST_F(LagrangeAudioCodecTest, TestSilkStatePool) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Failed to prepare SILK data";
+    result = silk_decode(silkData.data(), static_cast<int>(silkData.size()), testCallback, &decodedPcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare decoded PCM data";
+
+    SilkStatePool* pool = silk_pool_create(2);
+    ASSERT_TRUE(pool != nullptr) << "silk_pool_create function failed";
+    for (int i = 0; i < 3; i++) {
+        // A reused state must behave exactly like a fresh one
+        std::vector<uint8_t> pooledSilkData, pooledPcmData;
+        result = silk_encode_pooled(pool, pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &pooledSilkData);
+        EXPECT_EQ(result, 0) << "silk_encode_pooled function failed";
+        EXPECT_EQ(pooledSilkData, silkData) << "Pooled encoder output differs";
+        result = silk_decode_pooled(pool, silkData.data(), static_cast<int>(silkData.size()), testCallback, &pooledPcmData);
+        EXPECT_EQ(result, 0) << "silk_decode_pooled function failed";
+        EXPECT_EQ(pooledPcmData, decodedPcmData) << "Pooled decoder output differs";
+    }
+
+    SilkPoolStats stats = {};
+    silk_pool_get_stats(pool, &stats);
+    EXPECT_EQ(stats.encoderMisses, 1);
+    EXPECT_EQ(stats.encoderHits, 2);
+    EXPECT_EQ(stats.decoderMisses, 1);
+    EXPECT_EQ(stats.decoderHits, 2);
+    EXPECT_EQ(stats.idleEncoders, 1);
+    EXPECT_EQ(stats.idleDecoders, 1);
+    silk_pool_destroy(pool);
+}
+
+TEST_F(LagrangeAudioCodecTest, TestAudioToPcmChunked) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "audio_to_pcm function failed";
+
+    struct Chunks {
+        std::vector<uint8_t> data;
+        std::vector<int> sizes;
+    } chunks;
+    auto chunkCallback = [](void* userdata, const uint8_t* data, int len) {
+        auto self = static_cast<Chunks *>(userdata);
+        self->data.insert(self->data.end(), data, data + len);
+        self->sizes.push_back(len);
+    };
+
+    const AudioToPcmOptions options = { 100, 0 }; // 100 ms = 4800 bytes of 24 kHz mono PCM
+    result = audio_to_pcm_ex(audioData.data(), static_cast<int>(audioData.size()), &options, chunkCallback, &chunks);
+    EXPECT_EQ(result, 0) << "audio_to_pcm_ex function failed";
+    EXPECT_EQ(chunks.data, pcmData) << "Chunked output differs from audio_to_pcm";
+    ASSERT_FALSE(chunks.sizes.empty()) << "No PCM data was generated";
+    for (size_t i = 0; i + 1 < chunks.sizes.size(); i++) {
+        EXPECT_EQ(chunks.sizes[i], 4800) << "Chunk " << i << " has an unexpected size";
+    }
+    EXPECT_LE(chunks.sizes.back(), 4800) << "Tail chunk is larger than a chunk";
+}
+
+TEST_F(LagrangeAudioCodecTest, TestSilkEncoderOptions) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+
+    for (const char* preset : { "fast", "balanced", "quality" }) {
+        SilkEncoderOptions options = {};
+        ASSERT_EQ(silk_encoder_options_preset(preset, &options), 0) << "Unknown preset " << preset;
+
+        std::vector<uint8_t> localSilkData, localPcmData;
+        result = silk_encode_ex(pcmData.data(), static_cast<int>(pcmData.size()), &options, testCallback, &localSilkData);
+        EXPECT_EQ(result, 0) << "silk_encode_ex failed for preset " << preset;
+        result = silk_decode(localSilkData.data(), static_cast<int>(localSilkData.size()), testCallback, &localPcmData);
+        EXPECT_EQ(result, 0) << "silk_decode failed for preset " << preset;
+        EXPECT_EQ(localPcmData.size(), (pcmData.size() + 959) / 960 * 960) << "Decoded length is off for preset " << preset;
+    }
+
+    // 60 ms packets, the tail is padded up to a whole packet
+    SilkEncoderOptions options = {};
+    ASSERT_EQ(silk_encoder_options_preset("balanced", &options), 0);
+    options.packetSize = 60;
+    options.useInBandFEC = 1;
+    options.packetLossPercentage = 10;
+    std::vector<uint8_t> localSilkData, localPcmData;
+    result = silk_encode_ex(pcmData.data(), static_cast<int>(pcmData.size()), &options, testCallback, &localSilkData);
+    EXPECT_EQ(result, 0) << "silk_encode_ex failed with 60 ms packets";
+    result = silk_decode(localSilkData.data(), static_cast<int>(localSilkData.size()), testCallback, &localPcmData);
+    EXPECT_EQ(result, 0) << "silk_decode failed with 60 ms packets";
+    EXPECT_EQ(localPcmData.size(), (pcmData.size() + 2879) / 2880 * 2880) << "Decoded length is off with 60 ms packets";
+
+    EXPECT_NE(silk_encoder_options_preset("unknown", &options), 0);
+    options.packetSize = 30;
+    EXPECT_TRUE(silk_encoder_create_ex(&options, testCallback, &localSilkData) == nullptr) << "Invalid packet size accepted";
+}
+
+TEST(LagrangeSilkParallelTest, TestSilkEncodeParallel) {
+    // 45 s of a 24 kHz mono sweep, long enough for four segments
+    std::vector<uint8_t> pcm(45 * 24000 * 2);
+    for (size_t i = 0; i < pcm.size() / 2; i++) {
+        const double t = static_cast<double>(i) / 24000;
+        const auto sample = static_cast<int16_t>(8000 * std::sin(2 * 3.14159265358979 * (200 + 20 * t) * t));
+        memcpy(pcm.data() + i * 2, &sample, 2);
+    }
+
+    std::vector<uint8_t> serialSilk, parallelSilk, serialPcm, parallelPcm;
+    ASSERT_EQ(silk_encode(pcm.data(), static_cast<int>(pcm.size()), testCallback, &serialSilk), 0);
+    ASSERT_EQ(silk_encode_parallel(pcm.data(), static_cast<int>(pcm.size()), nullptr, 4, testCallback, &parallelSilk), 0)
+        << "silk_encode_parallel function failed";
+    EXPECT_NE(parallelSilk, serialSilk) << "Input was not split into segments";
+
+    ASSERT_EQ(silk_decode(serialSilk.data(), static_cast<int>(serialSilk.size()), testCallback, &serialPcm), 0);
+    ASSERT_EQ(silk_decode(parallelSilk.data(), static_cast<int>(parallelSilk.size()), testCallback, &parallelPcm), 0)
+        << "Parallel output is not a valid SILK stream";
+    EXPECT_EQ(parallelPcm.size(), serialPcm.size()) << "Parallel output has a different number of frames";
+}
+
+TEST_F(LagrangeAudioCodecTest, TestSilkProbeAndRange) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Failed to prepare SILK data";
+
+    SilkProbeInfo info = {};
+    result = silk_probe(silkData.data(), static_cast<int>(silkData.size()), &info);
+    EXPECT_EQ(result, 0) << "silk_probe function failed";
+    EXPECT_EQ(info.packets, static_cast<int>((pcmData.size() + 959) / 960)) << "Packet count is not expected";
+    EXPECT_EQ(info.durationMs, info.packets * 20) << "Duration is not expected";
+    EXPECT_GT(info.averageBitrate, 0);
+    EXPECT_FALSE(info.truncated);
+    EXPECT_FALSE(info.corrupt);
+
+    SilkProbeInfo truncatedInfo = {};
+    result = silk_probe(silkData.data(), static_cast<int>(silkData.size()) - 5, &truncatedInfo);
+    EXPECT_EQ(result, 0);
+    EXPECT_TRUE(truncatedInfo.truncated) << "Truncation was not detected";
+    EXPECT_EQ(truncatedInfo.packets, info.packets - 1);
+
+    ASSERT_GE(info.durationMs, 2000) << "Test audio is too short for a range decode";
+    std::vector<uint8_t> rangePcmData;
+    result = silk_decode_range(silkData.data(), static_cast<int>(silkData.size()), 1010, 2000, testCallback, &rangePcmData);
+    EXPECT_EQ(result, 0) << "silk_decode_range function failed";
+    EXPECT_EQ(rangePcmData.size(), 990u * 24 * 2) << "Range decode returned the wrong number of samples";
+
+    std::vector<uint8_t> tailPcmData;
+    result = silk_decode_range(silkData.data(), static_cast<int>(silkData.size()), info.durationMs - 100, 0, testCallback, &tailPcmData);
+    EXPECT_EQ(result, 0) << "silk_decode_range function failed on the tail";
+    EXPECT_EQ(tailPcmData.size(), 100u * 24 * 2) << "Tail decode returned the wrong number of samples";
+}
+
+TEST_F(LagrangeCodecTest, TestVideoFastProbe) {
+    ASSERT_TRUE(hasVideoData) << "Video test data not available";
+
+    const LagrangeProbeOptions probe = { 64 * 1024, 500000, 1, "mp4" };
+    VideoInfo info = {};
+    int result = video_get_size_ex(videoData.data(), static_cast<int>(videoData.size()), &probe, info);
+    EXPECT_EQ(result, 0) << "video_get_size_ex function failed";
+    EXPECT_EQ(info.width, 320) << "Video width is not expected";
+    EXPECT_EQ(info.height, 240) << "Video height is not expected";
+    EXPECT_NEAR(info.duration, 124, 1) << "Video duration is not expected";
+
+    lagrange_set_probe_options(&probe);
+    uint8_t* frameData = nullptr;
+    int frameLen = 0;
+    result = video_first_frame(videoData.data(), static_cast<int>(videoData.size()), frameData, frameLen);
+    lagrange_set_probe_options(nullptr);
+    EXPECT_EQ(result, 0) << "video_first_frame failed with the global probe options";
+    EXPECT_GT(frameLen, 0) << "Frame data is empty";
+}
+
+TEST_F(LagrangeCodecTest, TestVideoThumbnail) {
+    ASSERT_TRUE(hasVideoData) << "Video test data not available";
+
+    uint8_t* pngData = nullptr;
+    int pngLen = 0;
+    int result = video_first_frame(videoData.data(), static_cast<int>(videoData.size()), pngData, pngLen);
+    ASSERT_EQ(result, 0) << "video_first_frame function failed";
+
+    ThumbnailOptions options = { 160, 160, LAGRANGE_SCALE_AREA, LAGRANGE_IMAGE_JPEG, 75, nullptr };
+    uint8_t* jpegData = nullptr;
+    int jpegLen = 0;
+    result = video_thumbnail(videoData.data(), static_cast<int>(videoData.size()), &options, jpegData, jpegLen);
+    EXPECT_EQ(result, 0) << "video_thumbnail function failed";
+    ASSERT_GT(jpegLen, 3) << "Thumbnail is empty";
+    EXPECT_EQ(jpegData[0], 0xFF) << "Thumbnail is not a JPEG";
+    EXPECT_EQ(jpegData[1], 0xD8) << "Thumbnail is not a JPEG";
+    EXPECT_LT(jpegLen, pngLen) << "Thumbnail is not smaller than the full size PNG";
+
+    options.format = LAGRANGE_IMAGE_PNG;
+    uint8_t* smallPngData = nullptr;
+    int smallPngLen = 0;
+    result = video_thumbnail(videoData.data(), static_cast<int>(videoData.size()), &options, smallPngData, smallPngLen);
+    EXPECT_EQ(result, 0) << "video_thumbnail function failed for PNG";
+    ASSERT_GT(smallPngLen, 24) << "Thumbnail is empty";
+    const auto readBigEndian = [](const uint8_t* p) { return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; };
+    EXPECT_EQ(readBigEndian(smallPngData + 16), 160) << "Thumbnail width is not expected"; // 320x240 fitted into 160x160
+    EXPECT_EQ(readBigEndian(smallPngData + 20), 120) << "Thumbnail height is not expected";
+}
+
+TEST_F(LagrangeCodecTest, TestVideoFrames) {
+    ASSERT_TRUE(hasVideoData) << "Video test data not available";
+
+    std::vector<std::vector<uint8_t>> images;
+    const auto collect = [](void* userdata, const uint8_t* p, int len) {
+        static_cast<std::vector<std::vector<uint8_t>>*>(userdata)->emplace_back(p, p + len);
+    };
+
+    VideoFramesOptions options = {};
+    options.count = 4;
+    options.thumbnail = { 80, 80, LAGRANGE_SCALE_BILINEAR, LAGRANGE_IMAGE_PNG, 0, nullptr };
+    int result = video_frames(videoData.data(), static_cast<int>(videoData.size()), &options, collect, &images);
+    EXPECT_EQ(result, 0) << "video_frames function failed";
+    EXPECT_EQ(images.size(), 4u) << "Expected one image per timestamp";
+
+    const int64_t timestamps[] = { 0, 60000, 120000 };
+    options.timestampsMs = timestamps;
+    options.count = 3;
+    options.spriteColumns = 2;
+    images.clear();
+    result = video_frames(videoData.data(), static_cast<int>(videoData.size()), &options, collect, &images);
+    EXPECT_EQ(result, 0) << "video_frames function failed for the sprite sheet";
+    ASSERT_EQ(images.size(), 1u) << "Expected a single sprite sheet";
+    ASSERT_GT(images[0].size(), 24u) << "Sprite sheet is empty";
+    const auto readBigEndian = [](const uint8_t* p) { return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; };
+    EXPECT_EQ(readBigEndian(images[0].data() + 16), 2 * 80) << "Sprite sheet width is not expected";
+    EXPECT_EQ(readBigEndian(images[0].data() + 20), 2 * 60) << "Sprite sheet height is not expected";
+}
+
+TEST_F(LagrangeCodecTest, TestVideoThreadedDecode) {
+    ASSERT_TRUE(hasVideoData) << "Video test data not available";
+
+    uint8_t* frameData = nullptr;
+    int frameLen = 0;
+    int result = video_first_frame(videoData.data(), static_cast<int>(videoData.size()), frameData, frameLen);
+    ASSERT_EQ(result, 0) << "video_first_frame function failed";
+
+    // Frame threading holds frames back until the decoder is drained, the image must not change
+    ThumbnailOptions options = { 0, 0, LAGRANGE_SCALE_BILINEAR, LAGRANGE_IMAGE_PNG, 0, nullptr,
+                                 4, LAGRANGE_THREAD_FRAME | LAGRANGE_THREAD_SLICE };
+    uint8_t* threadedData = nullptr;
+    int threadedLen = 0;
+    result = video_thumbnail(videoData.data(), static_cast<int>(videoData.size()), &options, threadedData, threadedLen);
+    EXPECT_EQ(result, 0) << "video_thumbnail failed with frame threading";
+    ASSERT_EQ(threadedLen, frameLen) << "Threaded decode returned a different frame";
+    EXPECT_EQ(memcmp(threadedData, frameData, frameLen), 0) << "Threaded decode returned a different frame";
+
+    video_set_thread_budget(1);
+    result = video_thumbnail(videoData.data(), static_cast<int>(videoData.size()), &options, threadedData, threadedLen);
+    video_set_thread_budget(0);
+    EXPECT_EQ(result, 0) << "video_thumbnail failed with a single thread budget";
+}
+
+TEST_F(LagrangeCodecTest, TestVideoFastThumbnail) {
+    ASSERT_TRUE(hasVideoData) << "Video test data not available";
+
+    ThumbnailOptions options = { 160, 160, LAGRANGE_SCALE_BILINEAR, LAGRANGE_IMAGE_PNG, 0, nullptr, 0, 0, 1 };
+    uint8_t* imageData = nullptr;
+    int imageLen = 0;
+    const int result = video_thumbnail(videoData.data(), static_cast<int>(videoData.size()), &options, imageData, imageLen);
+    EXPECT_EQ(result, 0) << "video_thumbnail failed in fast decode mode";
+    ASSERT_GT(imageLen, 24) << "Thumbnail is empty";
+    const auto readBigEndian = [](const uint8_t* p) { return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; };
+    EXPECT_EQ(readBigEndian(imageData + 16), 160) << "Thumbnail width is not expected";
+    EXPECT_EQ(readBigEndian(imageData + 20), 120) << "Thumbnail height is not expected";
+}
+
+TEST_F(LagrangeCodecTest, TestFileEntryPoints) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+    ASSERT_TRUE(hasVideoData) << "Video test data not available";
+    const std::filesystem::path dataDir(LAGRANGECODEC_TEST_DATA_DIR);
+
+    std::vector<uint8_t> pcmData;
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "audio_to_pcm function failed";
+    std::vector<uint8_t> filePcmData;
+    result = audio_to_pcm_file((dataDir / "test_audio.mp3").string().c_str(), nullptr, testCallback, &filePcmData);
+    EXPECT_EQ(result, 0) << "audio_to_pcm_file function failed";
+    EXPECT_EQ(filePcmData, pcmData) << "audio_to_pcm_file output differs from audio_to_pcm";
+
+    VideoInfo info = {};
+    result = video_get_size_file((dataDir / "test_video.mp4").string().c_str(), info);
+    EXPECT_EQ(result, 0) << "video_get_size_file function failed";
+    EXPECT_EQ(info.width, 320) << "Video width is not expected";
+    EXPECT_EQ(info.height, 240) << "Video height is not expected";
+
+    const auto pcmPath = std::filesystem::temp_directory_path() / "lagrange_codec_test.pcm";
+    {
+        std::ofstream file(pcmPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(pcmData.data()), static_cast<std::streamsize>(pcmData.size()));
+    }
+    std::vector<uint8_t> silkData;
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "silk_encode function failed";
+    std::vector<uint8_t> fileSilkData;
+    result = silk_encode_file(pcmPath.string().c_str(), nullptr, testCallback, &fileSilkData);
+    std::filesystem::remove(pcmPath);
+    EXPECT_EQ(result, 0) << "silk_encode_file function failed";
+    EXPECT_EQ(fileSilkData, silkData) << "silk_encode_file output differs from silk_encode";
+
+    EXPECT_NE(silk_decode_file((dataDir / "missing.silk").string().c_str(), testCallback, &pcmData), 0)
+        << "silk_decode_file succeeded on a missing file";
+}
+
+TEST_F(LagrangeAudioCodecTest, TestOutputIntoBuffer) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "audio_to_pcm function failed";
+    const int pcmCapacity = audio_to_pcm_max_output_size(audioData.data(), static_cast<int>(audioData.size()), nullptr);
+    ASSERT_GE(pcmCapacity, static_cast<int>(pcmData.size())) << "PCM size estimate is too small";
+    std::vector<uint8_t> pcmBuffer(pcmCapacity);
+    result = audio_to_pcm_into(audioData.data(), static_cast<int>(audioData.size()), nullptr, pcmBuffer.data(), pcmCapacity);
+    ASSERT_EQ(result, static_cast<int>(pcmData.size())) << "audio_to_pcm_into wrote the wrong number of bytes";
+    EXPECT_TRUE(std::equal(pcmData.begin(), pcmData.end(), pcmBuffer.begin())) << "audio_to_pcm_into output differs";
+
+    // One callback for the header and one per packet
+    int callbacks = 0;
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), [](void* userdata, const uint8_t*, int) {
+        ++*static_cast<int*>(userdata);
+    }, &callbacks);
+    ASSERT_EQ(result, 0) << "silk_encode function failed";
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "silk_encode function failed";
+    SilkProbeInfo info = {};
+    ASSERT_EQ(silk_probe(silkData.data(), static_cast<int>(silkData.size()), &info), 0);
+    EXPECT_EQ(callbacks, info.packets + 1) << "Length prefix and payload were not passed together";
+
+    const int silkCapacity = silk_encode_max_output_size(static_cast<int>(pcmData.size()), nullptr);
+    ASSERT_GE(silkCapacity, static_cast<int>(silkData.size())) << "SILK size estimate is too small";
+    std::vector<uint8_t> silkBuffer(silkCapacity);
+    result = silk_encode_into(pcmData.data(), static_cast<int>(pcmData.size()), nullptr, silkBuffer.data(), silkCapacity);
+    ASSERT_EQ(result, static_cast<int>(silkData.size())) << "silk_encode_into wrote the wrong number of bytes";
+    EXPECT_TRUE(std::equal(silkData.begin(), silkData.end(), silkBuffer.begin())) << "silk_encode_into output differs";
+    result = silk_encode_into(pcmData.data(), static_cast<int>(pcmData.size()), nullptr, silkBuffer.data(), 100);
+    EXPECT_EQ(result, LAGRANGE_ERROR_BUFFER_TOO_SMALL) << "A short buffer was not reported";
+
+    // Options the encoder rejects have no output size either
+    SilkEncoderOptions badOptions = {};
+    ASSERT_EQ(silk_encoder_options_preset("default", &badOptions), 0);
+    badOptions.packetSize = 30;
+    EXPECT_EQ(silk_encode_max_output_size(static_cast<int>(pcmData.size()), &badOptions), LAGRANGE_ERROR_FAILED);
+    EXPECT_EQ(silk_encoder_create_ex(&badOptions, testCallback, &silkBuffer), nullptr);
+    badOptions.packetSize = 20;
+    badOptions.complexity = 99;
+    EXPECT_EQ(silk_encode_max_output_size(static_cast<int>(pcmData.size()), &badOptions), LAGRANGE_ERROR_FAILED);
+
+    result = silk_decode(silkData.data(), static_cast<int>(silkData.size()), testCallback, &decodedPcmData);
+    ASSERT_EQ(result, 0) << "silk_decode function failed";
+    const int decodeCapacity = silk_decode_max_output_size(silkData.data(), static_cast<int>(silkData.size()));
+    ASSERT_GE(decodeCapacity, static_cast<int>(decodedPcmData.size())) << "Decoded size estimate is too small";
+    std::vector<uint8_t> decodeBuffer(decodeCapacity);
+    result = silk_decode_into(silkData.data(), static_cast<int>(silkData.size()), decodeBuffer.data(), decodeCapacity);
+    ASSERT_EQ(result, static_cast<int>(decodedPcmData.size())) << "silk_decode_into wrote the wrong number of bytes";
+    EXPECT_TRUE(std::equal(decodedPcmData.begin(), decodedPcmData.end(), decodeBuffer.begin())) << "silk_decode_into output differs";
+}
+
+TEST_F(LagrangeAudioCodecTest, TestDecodeSizeWithCorruptPacket) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Failed to prepare SILK data";
+
+    std::vector<size_t> payloads; // Offsets of the packet payloads after the 10 byte header
+    for (size_t offset = 10; offset + 2 <= silkData.size();) {
+        const size_t size = silkData[offset] | silkData[offset + 1] << 8;
+        payloads.push_back(offset + 2);
+        offset += 2 + size;
+    }
+    ASSERT_GT(payloads.size(), 10u);
+
+    // Damage the TOC of a packet in the middle until the packet walk stops there
+    std::vector<uint8_t> damaged;
+    SilkProbeInfo info = {};
+    for (const uint8_t fill : { 0xFF, 0x00, 0xAA, 0x55 }) {
+        damaged = silkData;
+        const size_t payload = payloads[payloads.size() / 2];
+        const size_t size = damaged[payload - 2] | damaged[payload - 1] << 8;
+        std::fill_n(damaged.begin() + static_cast<std::ptrdiff_t>(payload), size, fill);
+        ASSERT_EQ(silk_probe(damaged.data(), static_cast<int>(damaged.size()), &info), 0);
+        if (info.corrupt) break;
+    }
+    ASSERT_TRUE(info.corrupt) << "Could not produce a corrupt packet";
+    EXPECT_LT(info.packets, static_cast<int>(payloads.size()));
+
+    // The decoder carries on past the damaged packet, the estimate must cover that
+    std::vector<uint8_t> decoded;
+    result = silk_decode(damaged.data(), static_cast<int>(damaged.size()), testCallback, &decoded);
+    ASSERT_EQ(result, 0) << "silk_decode failed on a damaged packet";
+    const int capacity = silk_decode_max_output_size(damaged.data(), static_cast<int>(damaged.size()));
+    ASSERT_GE(capacity, static_cast<int>(decoded.size())) << "Decoded size estimate is too small";
+    std::vector<uint8_t> buffer(capacity);
+    EXPECT_EQ(silk_decode_into(damaged.data(), static_cast<int>(damaged.size()), buffer.data(), capacity),
+              static_cast<int>(decoded.size()));
+}
+
+TEST(LagrangeSilkInputTest, TestSilkEncodeStereo48k) {
+    // One second of a 440 Hz tone at 48 kHz, the right channel at half the level of the left
+    std::vector<uint8_t> stereoData(48000 * 4);
+    for (int i = 0; i < 48000; i++) {
+        const auto value = static_cast<int16_t>(8000 * std::sin(2 * 3.14159265358979 * 440 * i / 48000));
+        const auto left = static_cast<uint16_t>(value);
+        const auto right = static_cast<uint16_t>(value / 2);
+        stereoData[i * 4] = left & 0xFF;
+        stereoData[i * 4 + 1] = left >> 8;
+        stereoData[i * 4 + 2] = right & 0xFF;
+        stereoData[i * 4 + 3] = right >> 8;
+    }
+
+    SilkEncoderOptions options = {};
+    ASSERT_EQ(silk_encoder_options_preset("balanced", &options), 0);
+    options.sampleRate = 48000;
+    options.channels = 2;
+
+    std::vector<uint8_t> silkData;
+    int result = silk_encode_ex(stereoData.data(), static_cast<int>(stereoData.size()), &options, testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "silk_encode_ex failed for 48 kHz stereo";
+    SilkProbeInfo info = {};
+    ASSERT_EQ(silk_probe(silkData.data(), static_cast<int>(silkData.size()), &info), 0);
+    EXPECT_EQ(info.durationMs, 1000) << "Encoded duration is not expected";
+
+    // Stereo samples split across pushes must give the same stream
+    std::vector<uint8_t> chunkedSilkData;
+    SilkEncoder* encoder = silk_encoder_create_ex(&options, testCallback, &chunkedSilkData);
+    ASSERT_NE(encoder, nullptr);
+    for (size_t offset = 0; offset < stereoData.size(); offset += 333) {
+        const int n = static_cast<int>(std::min<size_t>(333, stereoData.size() - offset));
+        ASSERT_EQ(silk_encoder_push(encoder, stereoData.data() + offset, n), 0);
+    }
+    EXPECT_EQ(silk_encoder_flush(encoder), 0);
+    silk_encoder_destroy(encoder);
+    EXPECT_EQ(chunkedSilkData, silkData) << "Chunked stereo push differs from a single push";
+
+    options.sampleRate = 22050;
+    EXPECT_NE(silk_encode_ex(stereoData.data(), static_cast<int>(stereoData.size()), &options, testCallback, &silkData), 0)
+        << "An unsupported input rate was accepted";
+}
+
+// 16 bit mono PCM WAV around samples
+static std::vector<uint8_t> makeWav(const std::vector<int16_t>& samples, int sampleRate) {
+    std::vector<uint8_t> wavData;
+    const auto put = [&wavData](uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) wavData.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    };
+    const auto dataBytes = static_cast<uint32_t>(samples.size() * 2);
+    wavData.insert(wavData.end(), { 'R', 'I', 'F', 'F' });
+    put(36 + dataBytes, 4);
+    wavData.insert(wavData.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    put(16, 4);
+    put(1, 2); // PCM
+    put(1, 2); // Mono
+    put(sampleRate, 4);
+    put(sampleRate * 2, 4);
+    put(2, 2);
+    put(16, 2);
+    wavData.insert(wavData.end(), { 'd', 'a', 't', 'a' });
+    put(dataBytes, 4);
+    for (const int16_t sample : samples) put(static_cast<uint16_t>(sample), 2);
+    return wavData;
+}
+
+// Fills [begin, end) of samples with a 440 Hz tone
+static void addTone(std::vector<int16_t>& samples, int sampleRate, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        samples[i] = static_cast<int16_t>(8000 * std::sin(2 * 3.14159265358979 * 440 * i / sampleRate));
+    }
+}
+
+TEST(LagrangeSilkInputTest, TestAudioToSilkTrimSilence) {
+    // 24 kHz mono WAV: 1 s of silence, 1 s of a 440 Hz tone, 1 s of silence
+    constexpr int sampleRate = 24000;
+    std::vector<int16_t> samples(3 * sampleRate, 0);
+    addTone(samples, sampleRate, sampleRate, 2 * sampleRate);
+    std::vector<uint8_t> wavData = makeWav(samples, sampleRate);
+
+    std::vector<uint8_t> silkData;
+    int result = audio_to_silk(wavData.data(), static_cast<int>(wavData.size()), nullptr, testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "audio_to_silk function failed";
+
+    int64_t trimmedMs = 0;
+    AudioToSilkOptions options = {};
+    options.trimSilence = 1;
+    options.trimmedMs = &trimmedMs;
+    std::vector<uint8_t> trimmedSilkData;
+    result = audio_to_silk(wavData.data(), static_cast<int>(wavData.size()), &options, testCallback, &trimmedSilkData);
+    ASSERT_EQ(result, 0) << "audio_to_silk failed with silence trimming";
+    EXPECT_NEAR(static_cast<double>(trimmedMs), 2000, 40) << "Trimmed duration is not expected";
+    EXPECT_LT(trimmedSilkData.size(), silkData.size()) << "Trimming did not shrink the output";
+
+    SilkProbeInfo info = {};
+    ASSERT_EQ(silk_probe(trimmedSilkData.data(), static_cast<int>(trimmedSilkData.size()), &info), 0);
+    EXPECT_NEAR(static_cast<double>(info.durationMs), 1000, 40) << "Trimmed stream duration is not expected";
+}
+
+TEST(LagrangeSilkInputTest, TestAudioToSilkTrimSilenceEdges) {
+    constexpr int sampleRate = 24000;
+    int64_t trimmedMs = 0;
+    AudioToSilkOptions options = {};
+    options.trimSilence = 1;
+    options.trimmedMs = &trimmedMs;
+
+    // 5 s of silence is dropped entirely
+    std::vector<uint8_t> wavData = makeWav(std::vector<int16_t>(5 * sampleRate, 0), sampleRate);
+    std::vector<uint8_t> silkData;
+    int result = audio_to_silk(wavData.data(), static_cast<int>(wavData.size()), &options, testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "audio_to_silk failed on a silent input";
+    EXPECT_NEAR(static_cast<double>(trimmedMs), 5000, 40) << "Silent input was not trimmed entirely";
+    SilkProbeInfo info = {};
+    ASSERT_EQ(silk_probe(silkData.data(), static_cast<int>(silkData.size()), &info), 0);
+    EXPECT_EQ(info.packets, 0) << "Silent input produced packets";
+
+    // A 200 ms pause in the middle of speech is shorter than minSilenceMs and stays
+    std::vector<int16_t> samples(sampleRate * 22 / 10, 0);
+    addTone(samples, sampleRate, 0, sampleRate);
+    addTone(samples, sampleRate, sampleRate * 12 / 10, static_cast<int>(samples.size()));
+    wavData = makeWav(samples, sampleRate);
+    silkData.clear();
+    trimmedMs = -1;
+    result = audio_to_silk(wavData.data(), static_cast<int>(wavData.size()), &options, testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "audio_to_silk failed with a short pause";
+    EXPECT_EQ(trimmedMs, 0) << "A pause in the middle of speech was trimmed";
+    ASSERT_EQ(silk_probe(silkData.data(), static_cast<int>(silkData.size()), &info), 0);
+    EXPECT_NEAR(static_cast<double>(info.durationMs), 2200, 40) << "Stream duration is not expected";
+
+    // A pause longer than the held back window is passed on to DTX, not trimmed
+    samples.assign(sampleRate * 7, 0);
+    addTone(samples, sampleRate, 0, sampleRate);
+    addTone(samples, sampleRate, sampleRate * 6, static_cast<int>(samples.size()));
+    wavData = makeWav(samples, sampleRate);
+    silkData.clear();
+    trimmedMs = -1;
+    result = audio_to_silk(wavData.data(), static_cast<int>(wavData.size()), &options, testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "audio_to_silk failed with a long pause";
+    EXPECT_EQ(trimmedMs, 0) << "A long pause in the middle of speech was trimmed";
+    ASSERT_EQ(silk_probe(silkData.data(), static_cast<int>(silkData.size()), &info), 0);
+    EXPECT_NEAR(static_cast<double>(info.durationMs), 7000, 40) << "Stream duration is not expected";
+}
+
+TEST_F(LagrangeCodecTest, TestLogCallback) {
+    if (!hasAudioData) {
+        GTEST_SKIP() << "Audio test data not available";
+    }
+
+    struct LogCapture {
+        std::vector<std::pair<int, std::string>> messages;
+    } capture;
+    const auto captureLog = [](void* userdata, int level, const char* message) {
+        static_cast<LogCapture*>(userdata)->messages.emplace_back(level, message);
+    };
+
+    std::vector<uint8_t> pcmData;
+    lagrange_set_log_callback(LAGRANGE_LOG_ERROR, captureLog, &capture);
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "audio_to_pcm failed";
+    EXPECT_TRUE(capture.messages.empty()) << "A successful call logged at the error level";
+
+    std::vector<uint8_t> garbage(4096, 0x5a);
+    result = audio_to_pcm(garbage.data(), static_cast<int>(garbage.size()), testCallback, &pcmData);
+    EXPECT_NE(result, 0) << "audio_to_pcm accepted garbage";
+    ASSERT_FALSE(capture.messages.empty()) << "The failure was not logged";
+    for (const auto& [level, message] : capture.messages) {
+        EXPECT_EQ(level, LAGRANGE_LOG_ERROR) << "Message above the requested level: " << message;
+        EXPECT_FALSE(message.empty());
+        EXPECT_NE(message.back(), '\n') << "Message kept its newline";
+    }
+
+    capture.messages.clear();
+    lagrange_set_log_callback(LAGRANGE_LOG_DEBUG, captureLog, &capture);
+    pcmData.clear();
+    result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "audio_to_pcm failed";
+    EXPECT_TRUE(std::any_of(capture.messages.begin(), capture.messages.end(),
+                            [](const auto& entry) { return entry.first == LAGRANGE_LOG_DEBUG; }))
+        << "Debug messages were not delivered";
+
+    capture.messages.clear();
+    lagrange_set_log_callback(LAGRANGE_LOG_QUIET, captureLog, &capture);
+    result = audio_to_pcm(garbage.data(), static_cast<int>(garbage.size()), testCallback, &pcmData);
+    EXPECT_NE(result, 0);
+    EXPECT_TRUE(capture.messages.empty()) << "Quiet level still logged";
+
+    // A sink may call back into the library, here it hands over to the capturing sink
+    static LogCapture* handover = nullptr;
+    handover = &capture;
+    lagrange_set_log_callback(LAGRANGE_LOG_ERROR, [](void*, int, const char*) {
+        lagrange_set_log_callback(LAGRANGE_LOG_ERROR, [](void* userdata, int level, const char* message) {
+            static_cast<LogCapture*>(userdata)->messages.emplace_back(level, message);
+        }, handover);
+    }, nullptr);
+    for (int i = 0; i < 2; i++) { // The first failure logs the handover, the second one is captured
+        result = audio_to_pcm(garbage.data(), static_cast<int>(garbage.size()), testCallback, &pcmData);
+        EXPECT_NE(result, 0);
+    }
+    EXPECT_FALSE(capture.messages.empty()) << "Messages after the handover were lost";
+
+    lagrange_set_log_callback(LAGRANGE_LOG_ERROR, nullptr, nullptr);
+}
+
+TEST_F(LagrangeCodecTest, TestCallStats) {
+    if (!hasAudioData) {
+        GTEST_SKIP() << "Audio test data not available";
+    }
+
+    std::vector<uint8_t> pcmData;
+    std::vector<uint8_t> silkData;
+    LagrangeCallStats callStats = {};
+    lagrange_stats_attach(&callStats);
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "audio_to_pcm failed";
+    lagrange_stats_attach(nullptr);
+
+    EXPECT_EQ(callStats.calls, 1);
+    EXPECT_GT(callStats.totalNs, 0);
+    EXPECT_GE(callStats.bytesIn, static_cast<int64_t>(audioData.size()) / 2) << "Input was not counted";
+    EXPECT_EQ(callStats.bytesOut, static_cast<int64_t>(pcmData.size())) << "Output was not counted";
+    EXPECT_GT(callStats.frames, 0);
+    EXPECT_GT(callStats.packets, 0);
+    EXPECT_GT(callStats.stageNs[LAGRANGE_STAGE_PROBE], 0);
+    EXPECT_GT(callStats.stageNs[LAGRANGE_STAGE_DECODE], 0);
+    EXPECT_GT(callStats.stageNs[LAGRANGE_STAGE_RESAMPLE], 0);
+    EXPECT_EQ(callStats.stageNs[LAGRANGE_STAGE_SILK_ENCODE], 0);
+
+    // A host allocation hook reports through lagrange_stats_count_allocation, here one per callback
+    LagrangeCallStats hookStats = {};
+    int callbacks = 0;
+    lagrange_stats_attach(&hookStats);
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), [](void* userdata, const uint8_t*, int) {
+        ++*static_cast<int*>(userdata);
+        lagrange_stats_count_allocation();
+    }, &callbacks);
+    lagrange_stats_count_allocation(); // Outside of a call
+    lagrange_stats_attach(nullptr);
+    ASSERT_EQ(result, 0) << "silk_encode failed";
+    EXPECT_EQ(hookStats.allocations, callbacks) << "Hook allocations were not attributed to the call";
+
+    lagrange_stats_reset();
+    lagrange_stats_enable(LAGRANGE_STATS_AGGREGATE | LAGRANGE_STATS_TRACE);
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "silk_encode failed";
+    std::vector<uint8_t> garbage(64, 0x5a);
+    EXPECT_NE(silk_decode(garbage.data(), static_cast<int>(garbage.size()), testCallback, &pcmData), 0);
+    lagrange_stats_enable(0);
+
+    LagrangeGlobalStats globalStats = {};
+    lagrange_stats_get(&globalStats);
+    EXPECT_EQ(globalStats.calls.count, 2);
+    EXPECT_EQ(globalStats.failures, 1);
+    EXPECT_EQ(globalStats.bytesOut, static_cast<int64_t>(silkData.size()));
+    const LagrangeLatencyStats& encodeStage = globalStats.stages[LAGRANGE_STAGE_SILK_ENCODE];
+    EXPECT_EQ(encodeStage.count, globalStats.frames) << "One encoder span per 20 ms frame";
+    int64_t histogramTotal = 0;
+    for (const int64_t bucket : encodeStage.histogram) {
+        histogramTotal += bucket;
+    }
+    EXPECT_EQ(histogramTotal, encodeStage.count);
+    EXPECT_GE(encodeStage.maxNs * encodeStage.count, encodeStage.totalNs);
+
+    std::vector<uint8_t> trace;
+    ASSERT_EQ(lagrange_trace_export(testCallback, &trace), 0);
+    const std::string traceJson(trace.begin(), trace.end());
+    EXPECT_EQ(traceJson.rfind("{\"traceEvents\":[", 0), 0u);
+    EXPECT_NE(traceJson.find("\"name\":\"silk_encode\",\"cat\":\"call\""), std::string::npos);
+    EXPECT_NE(traceJson.find("\"name\":\"silk_encode\",\"cat\":\"stage\""), std::string::npos);
+    EXPECT_EQ(traceJson.back(), '}');
+    lagrange_stats_reset();
+}
+
+struct SubmitTracker {
+    std::mutex mutex;
+    std::condition_variable done;
+    int completed = 0;
+};
+
+static SubmitTracker submitTracker;
+
+static void onJobComplete(LagrangeJob*) {
+    std::lock_guard lock(submitTracker.mutex);
+    submitTracker.completed++;
+    submitTracker.done.notify_all();
+}
+
+// Runs to completion on its own, the test waits on the promise
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+static DetachedTask awaitJobs(LagrangeJob encodeJob, LagrangeJob decodeJob, std::promise<std::pair<int, int>>& result) {
+    const int encodeStatus = co_await lagrange::submit(encodeJob);
+    const int decodeStatus = co_await lagrange::submit(decodeJob);
+    result.set_value({ encodeStatus, decodeStatus });
+}
+
+TEST_F(LagrangeAudioCodecTest, TestAsyncSubmit) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Failed to prepare SILK data";
+
+    // One worker and room for two jobs, the first one blocks in its callback until released
+    const LagrangePoolOptions poolOptions = { 1, 0, 2 };
+    ASSERT_EQ(lagrange_pool_configure(&poolOptions), 0) << "lagrange_pool_configure failed";
+
+    struct Gate {
+        std::promise<void> entered;
+        std::shared_future<void> release;
+    };
+    std::promise<void> release;
+    Gate gate = { {}, release.get_future().share() };
+    const auto blockOnce = [](void* userdata, const uint8_t*, int) {
+        auto* gate = static_cast<Gate*>(userdata);
+        if (gate->release.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            gate->entered.set_value();
+            gate->release.wait();
+        }
+    };
+
+    std::vector<uint8_t> decoded;
+    LagrangeJob blocking = { LAGRANGE_JOB_SILK_DECODE, silkData.data(), static_cast<int>(silkData.size()), blockOnce, &gate, -1 };
+    LagrangeJob queued = { LAGRANGE_JOB_SILK_DECODE, silkData.data(), static_cast<int>(silkData.size()), testCallback, &decoded, -1 };
+    LagrangeJob rejected = queued;
+    submitTracker.completed = 0;
+    ASSERT_EQ(lagrange_submit(&blocking, onJobComplete), 0);
+    gate.entered.get_future().wait();
+    ASSERT_EQ(lagrange_submit(&queued, onJobComplete), 0);
+    EXPECT_EQ(lagrange_jobs_in_flight(), 2);
+    EXPECT_EQ(lagrange_submit(&rejected, onJobComplete), LAGRANGE_ERROR_BUSY) << "A full queue accepted the job";
+
+    release.set_value();
+    {
+        std::unique_lock lock(submitTracker.mutex);
+        ASSERT_TRUE(submitTracker.done.wait_for(lock, std::chrono::seconds(30), [] { return submitTracker.completed == 2; }))
+            << "Jobs did not complete";
+    }
+    EXPECT_EQ(blocking.status, 0);
+    EXPECT_EQ(queued.status, 0);
+    EXPECT_EQ(rejected.status, -1) << "A rejected job was run";
+    EXPECT_FALSE(decoded.empty());
+
+    std::vector<uint8_t> encoded;
+    std::vector<uint8_t> badOutput;
+    uint8_t garbage[16] = { };
+    std::promise<std::pair<int, int>> statuses;
+    auto statusesReady = statuses.get_future();
+    awaitJobs({ LAGRANGE_JOB_SILK_ENCODE, pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &encoded, -1 },
+              { LAGRANGE_JOB_SILK_DECODE, garbage, sizeof(garbage), testCallback, &badOutput, -1 }, statuses);
+    ASSERT_EQ(statusesReady.wait_for(std::chrono::seconds(30)), std::future_status::ready) << "Coroutine did not finish";
+    const auto [encodeStatus, decodeStatus] = statusesReady.get();
+    EXPECT_EQ(encodeStatus, 0);
+    EXPECT_NE(decodeStatus, 0) << "Decoding garbage should fail";
+    EXPECT_EQ(encoded, silkData) << "Awaited silk_encode output differs";
+
+    const LagrangePoolOptions defaultOptions = { };
+    ASSERT_EQ(lagrange_pool_configure(&defaultOptions), 0);
+}
+
+TEST(LagrangePoolTest, TestConfigureFromWorker) {
+    // The completion runs on a worker of the shared pool and replaces that very pool
+    static std::promise<int> configured;
+    configured = {};
+    auto done = configured.get_future();
+    uint8_t garbage[16] = { };
+    std::vector<uint8_t> output;
+    LagrangeJob job = { LAGRANGE_JOB_SILK_DECODE, garbage, sizeof(garbage), testCallback, &output, -1 };
+    ASSERT_EQ(lagrange_submit(&job, [](LagrangeJob*) {
+        const LagrangePoolOptions options = { 2, 0, 0 };
+        configured.set_value(lagrange_pool_configure(&options));
+    }), 0);
+    ASSERT_EQ(done.wait_for(std::chrono::seconds(30)), std::future_status::ready) << "Reconfiguring from a worker hung";
+    EXPECT_EQ(done.get(), 0);
+
+    const LagrangePoolOptions defaultOptions = { };
+    ASSERT_EQ(lagrange_pool_configure(&defaultOptions), 0);
+}
+
+TEST(LagrangePoolTest, TestBatchFromWorker) {
+    // The only worker runs a batch of its own, which must complete on that worker alone
+    const LagrangePoolOptions poolOptions = { 1, 0, 0 };
+    ASSERT_EQ(lagrange_pool_configure(&poolOptions), 0);
+
+    static std::promise<int> batchFailed;
+    batchFailed = {};
+    auto done = batchFailed.get_future();
+    uint8_t garbage[16] = { };
+    std::vector<uint8_t> output;
+    LagrangeJob job = { LAGRANGE_JOB_SILK_DECODE, garbage, sizeof(garbage), testCallback, &output, -1 };
+    ASSERT_EQ(lagrange_submit(&job, [](LagrangeJob* outer) {
+        LagrangeJob inner[3] = { *outer, *outer, *outer };
+        batchFailed.set_value(lagrange_batch_run(inner, 3));
+    }), 0);
+    ASSERT_EQ(done.wait_for(std::chrono::seconds(30)), std::future_status::ready) << "Nested batch hung";
+    EXPECT_EQ(done.get(), 3) << "Every garbage job should fail";
+
+    const LagrangePoolOptions defaultOptions = { };
+    ASSERT_EQ(lagrange_pool_configure(&defaultOptions), 0);
+}
+
+TEST_F(LagrangeAudioCodecTest, TestCallLimits) {
+    ASSERT_TRUE(hasAudioData) << "Audio test data not available";
+
+    int result = audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &pcmData);
+    ASSERT_EQ(result, 0) << "Failed to prepare PCM data";
+
+    LagrangeCancelToken* token = lagrange_cancel_token_create();
+    ASSERT_NE(token, nullptr);
+    lagrange_cancel_token_cancel(token);
+    EXPECT_EQ(lagrange_cancel_token_is_cancelled(token), 1);
+
+    LagrangeCallLimits limits = { 0, token };
+    lagrange_set_call_limits(&limits);
+    std::vector<uint8_t> output;
+    EXPECT_EQ(silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &output), LAGRANGE_ERROR_CANCELLED);
+    EXPECT_TRUE(output.empty()) << "A cancelled call encoded a frame";
+    EXPECT_EQ(audio_to_pcm(audioData.data(), static_cast<int>(audioData.size()), testCallback, &output), LAGRANGE_ERROR_CANCELLED);
+    std::vector<uint8_t> buffer(silk_encode_max_output_size(static_cast<int>(pcmData.size()), nullptr));
+    EXPECT_EQ(silk_encode_into(pcmData.data(), static_cast<int>(pcmData.size()), nullptr, buffer.data(), static_cast<int>(buffer.size())),
+              LAGRANGE_ERROR_CANCELLED);
+
+    // The deadline is hit while the callback stalls, the call stops at the next frame
+    const auto stall = [](void*, const uint8_t*, int) { std::this_thread::sleep_for(std::chrono::milliseconds(5)); };
+    limits = { 1, nullptr };
+    lagrange_set_call_limits(&limits);
+    EXPECT_EQ(silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), stall, nullptr), LAGRANGE_ERROR_TIMEOUT);
+
+    lagrange_set_call_limits(nullptr);
+    result = silk_encode(pcmData.data(), static_cast<int>(pcmData.size()), testCallback, &silkData);
+    ASSERT_EQ(result, 0) << "Lifting the limits did not restore silk_encode";
+
+    std::vector<uint8_t> decoded;
+    LagrangeJob cancelled = { LAGRANGE_JOB_SILK_DECODE, silkData.data(), static_cast<int>(silkData.size()), testCallback, &decoded, -1, 0, token };
+    EXPECT_EQ(lagrange_job_run(&cancelled), LAGRANGE_ERROR_CANCELLED);
+    EXPECT_TRUE(decoded.empty()) << "A cancelled job was run";
+    LagrangeJob limited = { LAGRANGE_JOB_SILK_DECODE, silkData.data(), static_cast<int>(silkData.size()), testCallback, &decoded, -1, 60000, nullptr };
+    EXPECT_EQ(lagrange_batch_run(&limited, 1), 0);
+    EXPECT_EQ(limited.status, 0);
+    EXPECT_FALSE(decoded.empty());
+
+    lagrange_cancel_token_destroy(token);
+}
+
 int main(int argc, char** argv) {
     std::cout << "Starting LagrangeCodec tests..." << std::endl;
     testing::InitGoogleTest(&argc, argv);